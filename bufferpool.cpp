@@ -0,0 +1,197 @@
+#include "bufferpool.h"
+
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QPair>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+typedef QPair<int, int> BufferPoolKey;
+
+static QMutex s_statisticsMutex;
+static qint64 s_allocatorNanoseconds = 0;
+static int s_systemAllocations = 0;
+static qint64 s_pooledBytes = 0;
+
+static void account(qint64 nanoseconds, int allocations, qint64 bytes)
+{
+    QMutexLocker locker(&s_statisticsMutex);
+    s_allocatorNanoseconds += nanoseconds;
+    s_systemAllocations += allocations;
+    s_pooledBytes += bytes;
+}
+
+static QMutex s_poolsMutex;
+static QHash<BufferPoolKey, QSharedPointer<BufferPool> > s_pools;
+
+QSharedPointer<BufferPool> BufferPool::forSize(int cols, int rows)
+{
+    QMutexLocker locker(&s_poolsMutex);
+
+    const BufferPoolKey key(cols, rows);
+    QSharedPointer<BufferPool> pool = s_pools.value(key);
+    if (pool.isNull()) {
+        pool = QSharedPointer<BufferPool>(new BufferPool((size_t)cols * rows * MaxFreeBytesPerPixel));
+        s_pools.insert(key, pool);
+    }
+
+    return pool;
+}
+
+void BufferPool::trim()
+{
+    QMutexLocker locker(&s_poolsMutex);
+
+    QHash<BufferPoolKey, QSharedPointer<BufferPool> >::const_iterator it;
+    for (it = s_pools.constBegin(); it != s_pools.constEnd(); ++it)
+        it.value()->freeBlocks();
+}
+
+BufferPool::BufferPool(size_t maxFreeBytes)
+    : m_maxFreeBytes(maxFreeBytes)
+    , m_freeBytes(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    freeBlocks();
+}
+
+void BufferPool::freeBlocks()
+{
+    QMutexLocker locker(&m_mutex);
+
+    qint64 bytes = 0;
+    QHash<size_t, QVector<void *> >::const_iterator it;
+    for (it = m_free.constBegin(); it != m_free.constEnd(); ++it) {
+        Q_FOREACH (void *block, it.value())
+            qFreeAligned(block);
+        bytes += it.key() * it.value().size();
+    }
+    m_free.clear();
+    m_freeBytes = 0;
+
+    locker.unlock();
+    account(0, 0, -bytes);
+}
+
+// Every block starts with an Alignment-sized header holding its size, so
+// release() needs nothing but the pointer.
+void *BufferPool::acquire(size_t bytes)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QMutexLocker locker(&m_mutex);
+
+    char *block = 0;
+    int allocations = 0;
+    QVector<void *> &blocks = m_free[bytes];
+    if (!blocks.isEmpty()) {
+        block = static_cast<char *>(blocks.last());
+        blocks.removeLast();
+        m_freeBytes -= bytes;
+    } else {
+        block = static_cast<char *>(qMallocAligned(Alignment + bytes, Alignment));
+        if (!block)
+            qFatal("Unable to allocate %lu bytes", (unsigned long)bytes);
+        *reinterpret_cast<size_t *>(block) = bytes;
+        allocations = 1;
+    }
+
+    locker.unlock();
+    account(timer.nsecsElapsed(), allocations, allocations ? (qint64)bytes : 0);
+
+    return block + Alignment;
+}
+
+void BufferPool::release(void *buffer)
+{
+    if (!buffer)
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    char *block = static_cast<char *>(buffer) - Alignment;
+    const size_t bytes = *reinterpret_cast<size_t *>(block);
+
+    // Blocks of other sizes go first, as they are the ones the current
+    // engines no longer ask for
+    qint64 freed = 0;
+    QMutexLocker locker(&m_mutex);
+    QHash<size_t, QVector<void *> >::iterator it = m_free.begin();
+    while (m_freeBytes + bytes > m_maxFreeBytes && it != m_free.end()) {
+        if (it.key() == bytes || it.value().isEmpty()) {
+            ++it;
+            continue;
+        }
+        qFreeAligned(it.value().last());
+        it.value().removeLast();
+        m_freeBytes -= it.key();
+        freed += it.key();
+    }
+
+    if (m_freeBytes + bytes <= m_maxFreeBytes) {
+        m_free[bytes].append(block);
+        m_freeBytes += bytes;
+    } else {
+        qFreeAligned(block);
+        freed += bytes;
+    }
+    locker.unlock();
+
+    account(timer.nsecsElapsed(), 0, -freed);
+}
+
+void BufferPool::resetStatistics()
+{
+    QMutexLocker locker(&s_statisticsMutex);
+    s_allocatorNanoseconds = 0;
+    s_systemAllocations = 0;
+}
+
+qint64 BufferPool::allocatorNanoseconds()
+{
+    QMutexLocker locker(&s_statisticsMutex);
+    return s_allocatorNanoseconds;
+}
+
+int BufferPool::systemAllocations()
+{
+    QMutexLocker locker(&s_statisticsMutex);
+    return s_systemAllocations;
+}
+
+qint64 BufferPool::pooledBytes()
+{
+    QMutexLocker locker(&s_statisticsMutex);
+    return s_pooledBytes;
+}
+
+qint64 BufferPool::peakResidentBytes()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(Q_OS_MAC)
+    return usage.ru_maxrss;
+#else
+    return (qint64)usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
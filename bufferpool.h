@@ -0,0 +1,58 @@
+#ifndef BUFFERPOOL_H
+#define BUFFERPOOL_H
+
+#include <QHash>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QVector>
+
+// Recycles the image-sized buffers of FT instances. One pool is shared by
+// every FT of the same dimensions and outlives them, so consecutive runs on
+// one size reuse the memory of the previous run. A pool keeps at most
+// about the buffers of one engine free, MaxFreeBytesPerPixel per pixel of
+// its size, and frees what is released beyond that. Buffers are 64-byte
+// aligned and uninitialized; acquire() aborts when memory runs out.
+class BufferPool {
+public:
+    static const size_t Alignment = 64;
+    static const size_t MaxFreeBytesPerPixel = 64;
+
+    static QSharedPointer<BufferPool> forSize(int cols, int rows);
+    ~BufferPool();
+
+    void *acquire(size_t bytes);
+    void release(void *);
+
+    template <typename T> T *acquire(unsigned count);
+
+    // Frees the blocks no FT holds in every pool, e.g. between the sizes of
+    // a bench; buffers still in use go back to their pool as usual
+    static void trim();
+
+    // Process-wide counters, e.g. for the bench
+    static void resetStatistics();
+    static qint64 allocatorNanoseconds();
+    static int systemAllocations();
+    static qint64 pooledBytes();
+    static qint64 peakResidentBytes();
+
+private:
+    explicit BufferPool(size_t maxFreeBytes);
+    Q_DISABLE_COPY(BufferPool)
+
+    void freeBlocks();
+
+    const size_t m_maxFreeBytes;
+
+    QMutex m_mutex;
+    QHash<size_t, QVector<void *> > m_free;
+    size_t m_freeBytes;
+};
+
+template <typename T>
+T *BufferPool::acquire(unsigned count)
+{
+    return static_cast<T *>(acquire(count * sizeof(T)));
+}
+
+#endif // BUFFERPOOL_H
@@ -0,0 +1,410 @@
+#include "convolution.h"
+
+#include <string.h>
+
+#include "bufferpool.h"
+#include "fimage.h"
+#include "parallel.h"
+
+// Output rows, and spectrum values, handed to a thread at a time
+static const int kRowGrain = 8;
+static const int kSpectrumGrain = 16384;
+
+// Relative cost of one transform element per log2 of the transform size,
+// against one multiply-add of the direct method; measured with the
+// convolution bench on the mixed-radix engine
+static const double kFourierCost = 8.0;
+
+// Automatic tile sizes are this many kernel sizes, and at least kMinTileSize;
+// a batch of kTileBatch tiles is transformed at a time
+static const int kTileKernels = 8;
+static const int kMinTileSize = 64;
+static const int kTileBatch = 8;
+
+// Operations of a forward and an inverse transform of size values, the
+// product, and the copies in and out
+static double fourierCost(double size)
+{
+    return 2.0 * kFourierCost * size * log2(size) + 2.0 * size;
+}
+
+Convolution::Convolution(const float *kernel, int cols, int rows, Mode mode, FT::FTType type)
+    : m_kernel(cols * rows)
+    , m_cols(cols)
+    , m_rows(rows)
+    , m_type(type)
+    , m_method(AutomaticMethod)
+    , m_threadCount(Parallel::idealThreadCount())
+    , m_tileSize(0)
+{
+    // Correlation is convolution with the kernel turned by 180 degrees,
+    // which moves its center as well
+    if (mode == Correlate) {
+        for (int i = 0; i < cols * rows; ++i)
+            m_kernel[i] = kernel[cols * rows - 1 - i];
+        m_anchorX = cols - 1 - cols / 2;
+        m_anchorY = rows - 1 - rows / 2;
+    } else {
+        memcpy(m_kernel.data(), kernel, cols * rows * sizeof(float));
+        m_anchorX = cols / 2;
+        m_anchorY = rows / 2;
+    }
+}
+
+Convolution::~Convolution()
+{
+    QHash<QPair<int, int>, Spectrum>::const_iterator it;
+    for (it = m_spectra.constBegin(); it != m_spectra.constEnd(); ++it)
+        delete it.value().ft;
+}
+
+Convolution::Method Convolution::method() const
+{
+    return m_method;
+}
+
+void Convolution::setMethod(Method method)
+{
+    m_method = method;
+}
+
+Convolution::Method Convolution::preferredMethod(int cols, int rows) const
+{
+    if (!hasFastTransform(m_type))
+        return DirectMethod;
+
+    const double paddedCols = paddedSize(m_type, cols + m_cols - 1);
+    const double paddedRows = paddedSize(m_type, rows + m_rows - 1);
+
+    int tileCols;
+    int tileRows;
+    tileSizes(cols, rows, &tileCols, &tileRows);
+    const int tilesX = (cols + tileCols - m_cols) / (tileCols - m_cols + 1);
+    const int tilesY = (rows + tileRows - m_rows) / (tileRows - m_rows + 1);
+
+    const double direct = (double)cols * rows * m_cols * m_rows;
+    const double fourier = fourierCost(paddedCols * paddedRows);
+    const double tiled = (double)tilesX * tilesY * fourierCost((double)tileCols * tileRows);
+
+    if (direct <= fourier && direct <= tiled)
+        return DirectMethod;
+    return tiled < fourier ? TiledMethod : FourierMethod;
+}
+
+int Convolution::threadCount() const
+{
+    return m_threadCount;
+}
+
+void Convolution::setThreadCount(int threads)
+{
+    m_threadCount = qMax(1, threads);
+
+    QHash<QPair<int, int>, Spectrum>::const_iterator it;
+    for (it = m_spectra.constBegin(); it != m_spectra.constEnd(); ++it)
+        it.value().ft->setThreadCount(m_threadCount);
+}
+
+int Convolution::tileSize() const
+{
+    return m_tileSize;
+}
+
+void Convolution::setTileSize(int size)
+{
+    m_tileSize = qMax(0, size);
+}
+
+void Convolution::apply(const uchar *image, int cols, int rows, float *output)
+{
+    const Method method = m_method == AutomaticMethod ? preferredMethod(cols, rows) : m_method;
+
+    // Without an engine for the type only the direct method is left
+    if (method == FourierMethod && applyFourier(image, cols, rows, output))
+        return;
+    if (method == TiledMethod && applyTiled(image, cols, rows, output))
+        return;
+    applyDirect(image, cols, rows, output);
+}
+
+FImage Convolution::apply(const FImage &image)
+{
+    const QVector<uchar> data = image.data();
+    const int size = data.size();
+
+    QVector<float> output(size);
+    apply(data.constData(), image.width(), image.height(), output.data());
+
+    QVector<uchar> gray(size);
+    for (int i = 0; i < size; ++i)
+        gray[i] = (uchar)qBound(0.0f, output[i] + 0.5f, 255.0f);
+
+    return FImage(gray.data(), image.width(), image.height(), image.id());
+}
+
+// Sizes with no prime factor above 5 for the mixed-radix engine, whose
+// radix-7 and larger passes cost about twice as much per element, powers of
+// two for the radix-2 engines, and the size itself for the DFTs, which take
+// any size at a cost that only grows with it
+int Convolution::paddedSize(FT::FTType type, int n)
+{
+    switch (type) {
+    case FT::DFTCPU:
+    case FT::DFTGPU:
+    case FT::SEPARABLEDFTCPU:
+        return n;
+    case FT::MIXEDFFTCPU:
+    case FT::MIXEDFFTCPUDOUBLE:
+        for (int size = n;; ++size) {
+            int rest = size;
+            for (int p = 2; p <= 5; ++p) {
+                while (rest % p == 0)
+                    rest /= p;
+            }
+            if (rest == 1)
+                return size;
+        }
+    default: {
+        int size = 1;
+        while (size < n)
+            size *= 2;
+        return size;
+    }
+    }
+}
+
+bool Convolution::hasFastTransform(FT::FTType type)
+{
+    switch (type) {
+    case FT::DFTCPU:
+    case FT::DFTGPU:
+    case FT::SEPARABLEDFTCPU:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// Each output row adds up one shifted image row per kernel value, a loop
+// the compiler vectorizes
+void Convolution::applyDirect(const uchar *image, int cols, int rows, float *output) const
+{
+    QVector<float> values(cols * rows);
+    for (int i = 0; i < cols * rows; ++i)
+        values[i] = image[i];
+
+    Parallel::forRange(rows, kRowGrain, m_threadCount, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            float *out = output + y * cols;
+            memset(out, 0, cols * sizeof(float));
+
+            for (int j = 0; j < m_rows; ++j) {
+                const int sourceY = y + m_anchorY - j;
+                if (sourceY < 0 || sourceY >= rows)
+                    continue;
+
+                for (int i = 0; i < m_cols; ++i) {
+                    const float k = m_kernel[i + j * m_cols];
+                    const int dx = m_anchorX - i;
+                    const float *source = values.constData() + sourceY * cols + dx;
+                    const int x0 = qMax(0, -dx);
+                    const int x1 = qMin(cols, cols - dx);
+
+                    for (int x = x0; x < x1; ++x)
+                        out[x] += k * source[x];
+                }
+            }
+        }
+    });
+}
+
+bool Convolution::applyFourier(const uchar *image, int cols, int rows, float *output)
+{
+    const Spectrum *spectrum = this->spectrum(paddedSize(m_type, cols + m_cols - 1), paddedSize(m_type, rows + m_rows - 1));
+    if (!spectrum)
+        return false;
+
+    const Spectrum &s = *spectrum;
+    const unsigned size = s.cols * s.rows;
+
+    QSharedPointer<BufferPool> pool = BufferPool::forSize(s.cols, s.rows);
+    Complex *data = pool->acquire<Complex>(size);
+
+    Parallel::forRange(s.rows, kRowGrain, m_threadCount, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            Complex *row = data + y * s.cols;
+            int x = 0;
+            if (y < rows) {
+                for (; x < cols; ++x)
+                    row[x] = Complex(image[x + y * cols], 0.0);
+            }
+            for (; x < s.cols; ++x)
+                row[x] = Complex();
+        }
+    });
+
+    s.ft->transformInPlace(data);
+
+    const Complex *kernel = s.kernel.constData();
+    Parallel::forRange(size, kSpectrumGrain, m_threadCount, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const Complex a = data[i];
+            const Complex b = kernel[i];
+            data[i] = Complex(a.real * b.real - a.imag * b.imag, a.real * b.imag + a.imag * b.real);
+        }
+    });
+
+    s.ft->transformInPlace(data, true);
+
+    // The full convolution starts anchor values before the output
+    Parallel::forRange(rows, kRowGrain, m_threadCount, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const Complex *row = data + (y + m_anchorY) * s.cols + m_anchorX;
+            float *out = output + y * cols;
+            for (int x = 0; x < cols; ++x)
+                out[x] = row[x].real;
+        }
+    });
+
+    pool->release(data);
+
+    return true;
+}
+
+// Overlap-save: the tile with output origin (ox, oy) reads the image from
+// kernel - 1 - anchor values before it, so that its circular convolution
+// matches the linear one from kernel - 1 on
+bool Convolution::applyTiled(const uchar *image, int cols, int rows, float *output)
+{
+    int tileCols;
+    int tileRows;
+    tileSizes(cols, rows, &tileCols, &tileRows);
+
+    const int validCols = tileCols - m_cols + 1;
+    const int validRows = tileRows - m_rows + 1;
+    const int tilesX = (cols + validCols - 1) / validCols;
+    const int tilesY = (rows + validRows - 1) / validRows;
+    const int count = tilesX * tilesY;
+    const int shiftX = m_anchorX - m_cols + 1;
+    const int shiftY = m_anchorY - m_rows + 1;
+
+    const Spectrum *spectrum = this->spectrum(tileCols, tileRows);
+    if (!spectrum)
+        return false;
+
+    const Spectrum &s = *spectrum;
+    const unsigned tileSize = tileCols * tileRows;
+    const int batch = qMin(kTileBatch, count);
+
+    QSharedPointer<BufferPool> pool = BufferPool::forSize(tileCols, tileRows);
+    Complex *tiles = pool->acquire<Complex>(batch * tileSize);
+    QVector<Complex *> buffers(batch);
+    for (int t = 0; t < batch; ++t)
+        buffers[t] = tiles + t * tileSize;
+
+    const Complex *kernel = s.kernel.constData();
+
+    for (int first = 0; first < count; first += batch) {
+        const int n = qMin(batch, count - first);
+
+        Parallel::forRange(n * tileRows, kRowGrain, m_threadCount, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const int t = i / tileRows;
+                const int y = i - t * tileRows;
+                const int tile = first + t;
+                const int sourceX = tile % tilesX * validCols + shiftX;
+                const int sourceY = tile / tilesX * validRows + shiftY + y;
+
+                Complex *row = buffers[t] + y * tileCols;
+                if (sourceY < 0 || sourceY >= rows) {
+                    for (int x = 0; x < tileCols; ++x)
+                        row[x] = Complex();
+                    continue;
+                }
+
+                const uchar *source = image + sourceY * cols;
+                for (int x = 0; x < tileCols; ++x) {
+                    const int sx = sourceX + x;
+                    row[x] = sx >= 0 && sx < cols ? Complex(source[sx], 0.0) : Complex();
+                }
+            }
+        });
+
+        s.ft->transformBatch(buffers.constData(), buffers.constData(), n, false);
+
+        Parallel::forRange(n * tileSize, kSpectrumGrain, m_threadCount, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const Complex a = tiles[i];
+                const Complex b = kernel[i % tileSize];
+                tiles[i] = Complex(a.real * b.real - a.imag * b.imag, a.real * b.imag + a.imag * b.real);
+            }
+        });
+
+        s.ft->transformBatch(buffers.constData(), buffers.constData(), n, true);
+
+        Parallel::forRange(n * validRows, kRowGrain, m_threadCount, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                const int t = i / validRows;
+                const int r = i - t * validRows;
+                const int tile = first + t;
+                const int ox = tile % tilesX * validCols;
+                const int y = tile / tilesX * validRows + r;
+                if (y >= rows)
+                    continue;
+
+                const Complex *row = buffers[t] + (r + m_rows - 1) * tileCols + m_cols - 1;
+                float *out = output + y * cols + ox;
+                const int width = qMin(validCols, cols - ox);
+                for (int x = 0; x < width; ++x)
+                    out[x] = row[x].real;
+            }
+        });
+    }
+
+    pool->release(tiles);
+
+    return true;
+}
+
+// Tiles of tileSize(), or kTileKernels kernels, per side, at least twice the
+// kernel and no larger than the whole padded image
+void Convolution::tileSizes(int cols, int rows, int *tileCols, int *tileRows) const
+{
+    const int kernel = qMax(m_cols, m_rows);
+    const int size = m_tileSize ? m_tileSize : qMax(kMinTileSize, kTileKernels * kernel);
+
+    *tileCols = paddedSize(m_type, qMin(qMax(size, 2 * m_cols), cols + m_cols - 1));
+    *tileRows = paddedSize(m_type, qMin(qMax(size, 2 * m_rows), rows + m_rows - 1));
+}
+
+// The engine for transforms of paddedCols x paddedRows and the kernel's
+// spectrum at that size, made on first use; null if the type has no engine
+const Convolution::Spectrum *Convolution::spectrum(int paddedCols, int paddedRows)
+{
+    const QPair<int, int> key(paddedCols, paddedRows);
+    if (m_spectra.contains(key))
+        return &m_spectra[key];
+
+    Spectrum s;
+    s.cols = paddedCols;
+    s.rows = paddedRows;
+
+    FImage blank(s.cols, s.rows);
+    s.ft = FT::createFT(m_type, &blank);
+    if (!s.ft) {
+        qWarning("[ERROR] Unknown FT type %d, convolving directly", m_type);
+        return 0;
+    }
+    s.ft->setThreadCount(m_threadCount);
+
+    s.kernel = QVector<Complex>(s.cols * s.rows);
+    for (int j = 0; j < m_rows; ++j) {
+        for (int i = 0; i < m_cols; ++i)
+            s.kernel[i + j * s.cols] = Complex(m_kernel[i + j * m_cols], 0.0);
+    }
+    s.ft->transformInPlace(s.kernel.data());
+
+    m_spectra.insert(key, s);
+
+    return &m_spectra[key];
+}
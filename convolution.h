@@ -0,0 +1,101 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+#include <QHash>
+#include <QPair>
+#include <QVector>
+
+#include "ft.h"
+
+// Convolution or cross-correlation of gray images with one kernel. Small
+// kernels are applied directly. Large ones go through the frequency domain:
+// image and kernel are zero padded to a size the engine transforms well, at
+// least image + kernel - 1 so nothing wraps around, multiplied and
+// transformed back. The kernel's spectrum is kept per padded size, so a
+// kernel applied to many images of one size is transformed only once.
+//
+// For images much larger than the kernel, TiledMethod uses overlap-save:
+// each tile of tileSize() values per side is transformed whole, but only
+// the part its borders cannot wrap into, tile - kernel + 1 values per side,
+// is kept. Neighbouring tiles read overlapping input, so their outputs join
+// without seams. Tiles are transformed a batch at a time, which bounds the
+// memory by the tile size rather than the image size.
+class Convolution {
+public:
+    enum Mode {
+        Convolve = 0,
+        Correlate
+    };
+
+    enum Method {
+        AutomaticMethod = 0,
+        DirectMethod,
+        FourierMethod,
+        TiledMethod
+    };
+
+    // kernel holds rows rows of cols values
+    Convolution(const float *kernel, int cols, int rows, Mode mode = Convolve,
+                FT::FTType type = FT::MIXEDFFTCPU);
+    ~Convolution();
+
+    Method method() const;
+    void setMethod(Method);
+
+    // What AutomaticMethod applies to images of the given size, from the
+    // operation counts of the methods; always DirectMethod for engines
+    // without a fast transform
+    Method preferredMethod(int cols, int rows) const;
+
+    int threadCount() const;
+    void setThreadCount(int);
+
+    // Transform size of the tiles, per side; 0, the default, picks one
+    // several times the kernel size. Sizes too small for the kernel grow.
+    int tileSize() const;
+    void setTileSize(int);
+
+    // Output has the size of the image, with the kernel anchored at its
+    // center (cols / 2, rows / 2) and zeros outside the image
+    void apply(const uchar *image, int cols, int rows, float *output);
+    FImage apply(const FImage &image);
+
+    // Smallest size of at least n that engines of the type transform well
+    static int paddedSize(FT::FTType, int n);
+
+    // Whether engines of the type transform in n log n time; the DFT
+    // engines take n^2 per axis, and FourierMethod and TiledMethod never
+    // pay off on them
+    static bool hasFastTransform(FT::FTType);
+
+private:
+    Q_DISABLE_COPY(Convolution)
+
+    // Engine and kernel spectrum for one transform size
+    struct Spectrum {
+        FT *ft;
+        int cols;
+        int rows;
+        QVector<Complex> kernel;
+    };
+
+    void applyDirect(const uchar *image, int cols, int rows, float *output) const;
+    bool applyFourier(const uchar *image, int cols, int rows, float *output);
+    bool applyTiled(const uchar *image, int cols, int rows, float *output);
+    void tileSizes(int cols, int rows, int *tileCols, int *tileRows) const;
+    const Spectrum *spectrum(int paddedCols, int paddedRows);
+
+    QVector<float> m_kernel;
+    int m_cols;
+    int m_rows;
+    int m_anchorX;
+    int m_anchorY;
+    FT::FTType m_type;
+    Method m_method;
+    int m_threadCount;
+    int m_tileSize;
+
+    QHash<QPair<int, int>, Spectrum> m_spectra;
+};
+
+#endif // CONVOLUTION_H
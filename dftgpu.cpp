@@ -72,11 +72,12 @@ Complex *DFTGpu::calculateFourier(Complex *input, bool inverse)
     }
 
     m_gpu->release();
-    delete fInput;
+    delete[] fInput;
 
     Complex *result = new Complex[size];
     for (unsigned i = 0; i < size; ++i)
         result[i] = Complex(output[i].s[0], output[i].s[1]);
+    delete[] output;
 
     return result;
 }
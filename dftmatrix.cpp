@@ -0,0 +1,108 @@
+#include "dftmatrix.h"
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QtMath>
+
+typedef QPair<unsigned, bool> DFTMatrixKey;
+
+// Bytes held by the cache at most, counting both tables of every matrix;
+// the least recently asked for are dropped first. One matrix may use the
+// whole budget, so n = 11585 is the largest size.
+static const quint64 kMaxCacheBytes = Q_UINT64_C(1) << 30;
+
+static quint64 matrixBytes(unsigned n)
+{
+    return 2 * (quint64)n * n * sizeof(float);
+}
+
+QSharedPointer<const DFTMatrix> DFTMatrix::matrix(unsigned n, bool inverse)
+{
+    static QMutex mutex;
+    static QHash<DFTMatrixKey, QSharedPointer<const DFTMatrix> > cache;
+    static QList<DFTMatrixKey> recent;
+    static quint64 cachedBytes = 0;
+
+    if (!n)
+        return QSharedPointer<const DFTMatrix>();
+
+    if (matrixBytes(n) > kMaxCacheBytes) {
+        qWarning("DFT matrix of size %u is too large", n);
+        return QSharedPointer<const DFTMatrix>();
+    }
+
+    QMutexLocker locker(&mutex);
+
+    const DFTMatrixKey key(n, inverse);
+    QSharedPointer<const DFTMatrix> cached = cache.value(key);
+    if (cached.isNull()) {
+        cached = QSharedPointer<const DFTMatrix>(new DFTMatrix(n, inverse));
+        cache.insert(key, cached);
+        cachedBytes += matrixBytes(n);
+    }
+
+    recent.removeAll(key);
+    recent.append(key);
+    while (cachedBytes > kMaxCacheBytes) {
+        const DFTMatrixKey oldest = recent.takeFirst();
+        cache.remove(oldest);
+        cachedBytes -= matrixBytes(oldest.first);
+    }
+
+    return cached;
+}
+
+// Only n distinct factors exist; k * x is reduced modulo n so every entry
+// is one exactly rounded value of the n-th roots of unity.
+DFTMatrix::DFTMatrix(unsigned n, bool inverse)
+    : m_size(n)
+    , m_inverse(inverse)
+    , m_cos(n * n)
+    , m_sin(n * n)
+{
+    const double dir = inverse ? 1.0 : -1.0;
+
+    QVector<float> rootCos(n);
+    QVector<float> rootSin(n);
+    for (unsigned j = 0; j < n; ++j) {
+        const double angle = dir * 2.0 * M_PI * (double)j / (double)n;
+        rootCos[j] = (float)cos(angle);
+        rootSin[j] = (float)sin(angle);
+    }
+
+    for (unsigned k = 0; k < n; ++k) {
+        float *c = m_cos.data() + (size_t)k * n;
+        float *s = m_sin.data() + (size_t)k * n;
+        unsigned j = 0;
+        for (unsigned x = 0; x < n; ++x) {
+            c[x] = rootCos[j];
+            s[x] = rootSin[j];
+            j += k;
+            if (j >= n)
+                j -= n;
+        }
+    }
+}
+
+unsigned DFTMatrix::size() const
+{
+    return m_size;
+}
+
+bool DFTMatrix::isInverse() const
+{
+    return m_inverse;
+}
+
+const float *DFTMatrix::cosRow(unsigned k) const
+{
+    return m_cos.constData() + (size_t)k * m_size;
+}
+
+const float *DFTMatrix::sinRow(unsigned k) const
+{
+    return m_sin.constData() + (size_t)k * m_size;
+}
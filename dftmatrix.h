@@ -0,0 +1,33 @@
+#ifndef DFTMATRIX_H
+#define DFTMATRIX_H
+
+#include <QSharedPointer>
+#include <QVector>
+
+// Split cos and sin matrices of the 1D DFT of length n, n * n entries
+// each. Row k holds exp(dir * 2 pi i k x / n) for every x, so a transform
+// is one contiguous dot product per output. Matrices are shared like FFT
+// plans; the cache keeps the most recently used ones up to 1 GB of tables
+// in total, and matrix() returns null for sizes that alone would pass it.
+class DFTMatrix {
+public:
+    static QSharedPointer<const DFTMatrix> matrix(unsigned n, bool inverse);
+
+    unsigned size() const;
+    bool isInverse() const;
+
+    const float *cosRow(unsigned k) const;
+    const float *sinRow(unsigned k) const;
+
+private:
+    DFTMatrix(unsigned n, bool inverse);
+    Q_DISABLE_COPY(DFTMatrix)
+
+    unsigned m_size;
+    bool m_inverse;
+
+    QVector<float> m_cos;
+    QVector<float> m_sin;
+};
+
+#endif // DFTMATRIX_H
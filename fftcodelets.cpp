@@ -0,0 +1,280 @@
+#include "fftcodelets.h"
+
+#include <string.h>
+
+#include <QtMath>
+
+#if defined(__GNUC__)
+#define CODELET_INLINE inline __attribute__((always_inline))
+#define CODELET_NOINLINE __attribute__((noinline))
+#define CODELET_RESTRICT __restrict__
+#elif defined(_MSC_VER)
+#define CODELET_INLINE __forceinline
+#define CODELET_NOINLINE __declspec(noinline)
+#define CODELET_RESTRICT __restrict
+#else
+#define CODELET_INLINE inline
+#define CODELET_NOINLINE
+#define CODELET_RESTRICT
+#endif
+
+// Taylor series, accurate to well below float precision on [0, 2 pi), the
+// range of every twiddle angle below. Written as single-return recursions so they are
+// constexpr under C++11.
+static constexpr double sineSeries(double x2, double term, int k)
+{
+    return k > 20 ? term : term + sineSeries(x2, -term * x2 / ((2 * k) * (2 * k + 1)), k + 1);
+}
+
+static constexpr double cosineSeries(double x2, double term, int k)
+{
+    return k > 20 ? term : term + cosineSeries(x2, -term * x2 / ((2 * k - 1) * (2 * k)), k + 1);
+}
+
+static constexpr double sine(double x)
+{
+    return sineSeries(x * x, x, 1);
+}
+
+static constexpr double cosine(double x)
+{
+    return cosineSeries(x * x, 1.0, 1);
+}
+
+// W_N^K = exp(Dir * 2 pi i K / N)
+template <int N, int K, int Dir>
+struct Twiddle {
+    static constexpr float real = (float)cosine(2.0 * M_PI * K / N);
+    static constexpr float imag = (float)(Dir * sine(2.0 * M_PI * K / N));
+};
+
+template <int... I>
+struct IndexList {
+};
+
+template <int N, int... I>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {
+};
+
+template <int... I>
+struct MakeIndexList<0, I...> {
+    typedef IndexList<I...> Type;
+};
+
+// W^k, W^2k and W^3k for k < N / 4 as constant arrays, for the larger
+// sizes whose butterflies run as a loop
+template <int N, int Dir, typename = typename MakeIndexList<N / 4>::Type>
+struct TwiddleTable;
+
+template <int N, int Dir, int... K>
+struct TwiddleTable<N, Dir, IndexList<K...> > {
+    static constexpr float w1r[N / 4] = { Twiddle<N, K, Dir>::real... };
+    static constexpr float w1i[N / 4] = { Twiddle<N, K, Dir>::imag... };
+    static constexpr float w2r[N / 4] = { Twiddle<N, 2 * K, Dir>::real... };
+    static constexpr float w2i[N / 4] = { Twiddle<N, 2 * K, Dir>::imag... };
+    static constexpr float w3r[N / 4] = { Twiddle<N, 3 * K, Dir>::real... };
+    static constexpr float w3i[N / 4] = { Twiddle<N, 3 * K, Dir>::imag... };
+};
+
+template <int N, int Dir, int... K> constexpr float TwiddleTable<N, Dir, IndexList<K...> >::w1r[N / 4];
+template <int N, int Dir, int... K> constexpr float TwiddleTable<N, Dir, IndexList<K...> >::w1i[N / 4];
+template <int N, int Dir, int... K> constexpr float TwiddleTable<N, Dir, IndexList<K...> >::w2r[N / 4];
+template <int N, int Dir, int... K> constexpr float TwiddleTable<N, Dir, IndexList<K...> >::w2i[N / 4];
+template <int N, int Dir, int... K> constexpr float TwiddleTable<N, Dir, IndexList<K...> >::w3r[N / 4];
+template <int N, int Dir, int... K> constexpr float TwiddleTable<N, Dir, IndexList<K...> >::w3i[N / 4];
+
+// Complex multiplication by W_N^K; the K = 0 factor is skipped
+template <int N, int K, int Dir>
+static CODELET_INLINE void twiddle(float &re, float &im)
+{
+    if (K == 0)
+        return;
+
+    const float wr = Twiddle<N, K, Dir>::real;
+    const float wi = Twiddle<N, K, Dir>::imag;
+    const float r = re * wr - im * wi;
+    im = im * wr + re * wi;
+    re = r;
+}
+
+// Radix-4 butterflies K, K + 1, ..., N / 4 - 1 joining the four transforms
+// of length N / 4 stored one after another in re/im
+template <int N, int K, int Dir, bool Done = (4 * K >= N)>
+struct Combine {
+    static CODELET_INLINE void run(float *re, float *im)
+    {
+        const int q = N / 4;
+
+        float ar = re[K], ai = im[K];
+        float br = re[K + q], bi = im[K + q];
+        float cr = re[K + 2 * q], ci = im[K + 2 * q];
+        float dr = re[K + 3 * q], di = im[K + 3 * q];
+
+        twiddle<N, K, Dir>(br, bi);
+        twiddle<N, 2 * K, Dir>(cr, ci);
+        twiddle<N, 3 * K, Dir>(dr, di);
+
+        const float s0r = ar + cr, s0i = ai + ci;
+        const float d0r = ar - cr, d0i = ai - ci;
+        const float s1r = br + dr, s1i = bi + di;
+        // Dir * i * (b - d)
+        const float d1r = -Dir * (bi - di), d1i = Dir * (br - dr);
+
+        re[K] = s0r + s1r;
+        im[K] = s0i + s1i;
+        re[K + q] = d0r + d1r;
+        im[K + q] = d0i + d1i;
+        re[K + 2 * q] = s0r - s1r;
+        im[K + 2 * q] = s0i - s1i;
+        re[K + 3 * q] = d0r - d1r;
+        im[K + 3 * q] = d0i - d1i;
+
+        Combine<N, K + 1, Dir>::run(re, im);
+    }
+};
+
+template <int N, int K, int Dir>
+struct Combine<N, K, Dir, true> {
+    static CODELET_INLINE void run(float *, float *)
+    {
+    }
+};
+
+// The larger sizes run their butterflies as a loop over the constant
+// twiddle tables; unrolled, their code no longer fits the instruction cache.
+template <int N, int Dir, bool Loop = (N > 32)>
+struct Butterflies {
+    static CODELET_INLINE void run(float *re, float *im)
+    {
+        Combine<N, 0, Dir>::run(re, im);
+    }
+};
+
+template <int N, int Dir>
+struct Butterflies<N, Dir, true> {
+    static CODELET_INLINE void run(float *CODELET_RESTRICT re, float *CODELET_RESTRICT im)
+    {
+        typedef TwiddleTable<N, Dir> W;
+        const int q = N / 4;
+
+        for (int k = 0; k < q; ++k) {
+            const float ar = re[k], ai = im[k];
+            const float xr = re[k + q], xi = im[k + q];
+            const float yr = re[k + 2 * q], yi = im[k + 2 * q];
+            const float zr = re[k + 3 * q], zi = im[k + 3 * q];
+
+            const float br = xr * W::w1r[k] - xi * W::w1i[k], bi = xi * W::w1r[k] + xr * W::w1i[k];
+            const float cr = yr * W::w2r[k] - yi * W::w2i[k], ci = yi * W::w2r[k] + yr * W::w2i[k];
+            const float dr = zr * W::w3r[k] - zi * W::w3i[k], di = zi * W::w3r[k] + zr * W::w3i[k];
+
+            const float s0r = ar + cr, s0i = ai + ci;
+            const float d0r = ar - cr, d0i = ai - ci;
+            const float s1r = br + dr, s1i = bi + di;
+            const float d1r = -Dir * (bi - di), d1i = Dir * (br - dr);
+
+            re[k] = s0r + s1r;
+            im[k] = s0i + s1i;
+            re[k + q] = d0r + d1r;
+            im[k + q] = d0i + d1i;
+            re[k + 2 * q] = s0r - s1r;
+            im[k + 2 * q] = s0i - s1i;
+            re[k + 3 * q] = d0r - d1r;
+            im[k + 3 * q] = d0i - d1i;
+        }
+    }
+};
+
+// Out-of-place radix-4 decimation in time: the N inputs x[0], x[S], ...
+// are split into four interleaved subsequences, each transformed into one
+// quarter of y. Up to 32 points everything is inlined into straight-line
+// code; the larger sizes call their quarter transforms out of line.
+template <int N, int S, int Dir, bool Inline = (N <= 32)>
+struct Codelet {
+    static CODELET_INLINE void run(const float *xr, const float *xi, float *yr, float *yi)
+    {
+        const int q = N / 4;
+
+        Codelet<q, 4 * S, Dir>::run(xr, xi, yr, yi);
+        Codelet<q, 4 * S, Dir>::run(xr + S, xi + S, yr + q, yi + q);
+        Codelet<q, 4 * S, Dir>::run(xr + 2 * S, xi + 2 * S, yr + 2 * q, yi + 2 * q);
+        Codelet<q, 4 * S, Dir>::run(xr + 3 * S, xi + 3 * S, yr + 3 * q, yi + 3 * q);
+        Butterflies<N, Dir>::run(yr, yi);
+    }
+};
+
+template <int N, int S, int Dir>
+struct Codelet<N, S, Dir, false> {
+    static CODELET_NOINLINE void run(const float *xr, const float *xi, float *yr, float *yi)
+    {
+        Codelet<N, S, Dir, true>::run(xr, xi, yr, yi);
+    }
+};
+
+template <int S, int Dir>
+struct Codelet<2, S, Dir, true> {
+    static CODELET_INLINE void run(const float *xr, const float *xi, float *yr, float *yi)
+    {
+        const float ar = xr[0], ai = xi[0];
+        const float br = xr[S], bi = xi[S];
+
+        yr[0] = ar + br;
+        yi[0] = ai + bi;
+        yr[1] = ar - br;
+        yi[1] = ai - bi;
+    }
+};
+
+template <int S, int Dir>
+struct Codelet<1, S, Dir, true> {
+    static CODELET_INLINE void run(const float *xr, const float *xi, float *yr, float *yi)
+    {
+        yr[0] = xr[0];
+        yi[0] = xi[0];
+    }
+};
+
+template <int N, int Dir>
+static void codelet(float *real, float *imag, float *work)
+{
+    Codelet<N, 1, Dir>::run(real, imag, work, work + N);
+
+    memcpy(real, work, N * sizeof(float));
+    memcpy(imag, work + N, N * sizeof(float));
+}
+
+// Indexed by log2 of the size
+static const FFTCodelets::Function s_forward[] = {
+    0, 0, 0,
+    codelet<8, -1>, codelet<16, -1>, codelet<32, -1>,
+    codelet<64, -1>, codelet<128, -1>, codelet<256, -1>
+};
+
+static const FFTCodelets::Function s_inverse[] = {
+    0, 0, 0,
+    codelet<8, 1>, codelet<16, 1>, codelet<32, 1>,
+    codelet<64, 1>, codelet<128, 1>, codelet<256, 1>
+};
+
+static bool s_enabled = true;
+
+FFTCodelets::Function FFTCodelets::find(unsigned n, bool inverse)
+{
+    if (!s_enabled || n < MinSize || n > MaxSize || (n & (n - 1)))
+        return 0;
+
+    int index = 0;
+    while ((1u << index) < n)
+        ++index;
+
+    return inverse ? s_inverse[index] : s_forward[index];
+}
+
+bool FFTCodelets::isEnabled()
+{
+    return s_enabled;
+}
+
+void FFTCodelets::setEnabled(bool enabled)
+{
+    s_enabled = enabled;
+}
@@ -0,0 +1,24 @@
+#ifndef FFTCODELETS_H
+#define FFTCODELETS_H
+
+// Straight-line transforms of the small power-of-two sizes, generated from
+// templates at compile time with every twiddle factor folded in as a
+// constant. They have no loop control or index math left, which is most of
+// the work the generic stage loops do on short rows and columns.
+class FFTCodelets {
+public:
+    static const unsigned MinSize = 8;
+    static const unsigned MaxSize = 256;
+
+    // Transforms natural-order split data in place, unnormalized; work holds
+    // 2n scratch floats like in FFTCpu::fft1D()
+    typedef void (*Function)(float *real, float *imag, float *work);
+
+    // Codelet of size n, or 0 if there is none or codelets are disabled
+    static Function find(unsigned n, bool inverse);
+
+    static bool isEnabled();
+    static void setEnabled(bool);
+};
+
+#endif // FFTCODELETS_H
@@ -1,109 +1,325 @@
 #include "fftcpu.h"
 
+#include "bufferpool.h"
+#include "fftcodelets.h"
+#include "fftkernels.h"
+#include "fftplan.h"
+#include "parallel.h"
+
+// Rows handed to a thread at a time
+static const int kGrain = 8;
+
+// Columns transposed and transformed together in the column pass
+static const int kTile = 16;
+
 FFTCpu::FFTCpu(FImage *image, QObject *parent)
     : FT(image, parent)
 {
 }
 
+FFTCpu::FFTCpu(FImage *image, SpectrumLayout layout, QObject *parent)
+    : FT(image, layout, parent)
+{
+}
+
 FFTCpu::~FFTCpu()
 {
+    for (int i = 0; i < m_scratch.size(); ++i)
+        m_pool->release(m_scratch[i].first);
+}
+
+QString FFTCpu::variant() const
+{
+    QString variant = QStringLiteral("%1 butterflies").arg(FFTKernels::isaName(FFTKernels::isa()));
+    if (FFTCodelets::isEnabled())
+        variant += QStringLiteral(", codelets %1-%2").arg(FFTCodelets::MinSize).arg(FFTCodelets::MaxSize);
+
+    return variant;
 }
 
 Complex *FFTCpu::calculateFourier(Complex *input, bool inverse)
+{
+    Complex *fourier = new Complex[m_rows * m_cols];
+    calculateFourierInto(input, fourier, inverse);
+
+    return fourier;
+}
+
+void FFTCpu::calculateFourierInto(const Complex *input, Complex *fourier, bool inverse)
+{
+    calculateFourierBatchInto(&input, &fourier, 1, inverse);
+}
+
+// The rows of all images form one parallel pass, and so do their column
+// tiles, so small images of a batch still keep every thread busy. Every
+// row is read into scratch before its output row is written, so outputs
+// may alias inputs.
+void FFTCpu::calculateFourierBatchInto(const Complex *const *inputs, Complex *const *outputs,
+                                       int count, bool inverse)
 {
     const int size = m_rows * m_cols;
     const float norm = inverse ? 1.0 / size : 1.0;
-    Complex *fourier = new Complex[size];
 
     if (!IS_POWER_OF_TWO(m_rows) || !IS_POWER_OF_TWO(m_cols)) {
         qWarning("Image width or height is not power of 2! (%dx%d)", m_cols, m_rows);
-        return fourier;
+        for (int i = 0; i < count; ++i)
+            memset(outputs[i], 0, size * sizeof(Complex));
+        return;
     }
 
-    memcpy(fourier, input, size * sizeof(Complex));
+    QSharedPointer<const FFTPlan> rowPlan = FFTPlan::plan(m_cols, inverse);
+    QSharedPointer<const FFTPlan> colPlan = FFTPlan::plan(m_rows, inverse);
+    prepareScratch();
 
-    for (int i = 0; i < size; i += m_cols)
-        fft1D(&fourier[i], (unsigned)m_cols, inverse);
+    Parallel::forRangeIndexed(count * m_rows, kGrain, m_threadCount, [&](int worker, int begin, int end) {
+        float *real = workerScratch(worker, 4 * m_cols);
+        float *imag = real + m_cols;
+        float *work = imag + m_cols;
 
-    Complex column[m_rows];
-    for (int x = 0; x < m_cols; ++x) {
-        for (int y = 0; y < m_rows; ++y) {
-            int index = x + y * m_cols;
-            column[y] = fourier[index];
-        }
+        for (int i = begin; i < end; ++i) {
+            const int image = i / m_rows;
+            const int y = i - image * m_rows;
 
-        fft1D(&column[0], (unsigned)m_rows, inverse);
+            const Complex *row = &inputs[image][y * m_cols];
+            for (int x = 0; x < m_cols; ++x) {
+                real[x] = row[x].real;
+                imag[x] = row[x].imag;
+            }
 
-        for (int y = 0; y < m_rows; ++y) {
-            int index = x + y * m_cols;
-            fourier[index] = column[y];
-            fourier[index].real *= norm;
-            fourier[index].imag *= norm;
+            fft1D(real, imag, work, *rowPlan);
+
+            Complex *out = &outputs[image][y * m_cols];
+            for (int x = 0; x < m_cols; ++x) {
+                out[x].real = real[x];
+                out[x].imag = imag[x];
+            }
         }
-    }
+    });
 
-    return fourier;
+    columnPass(outputs, count, m_cols, *colPlan, norm);
 }
 
-void FFTCpu::fft1D(Complex *vector, unsigned n, bool inverse) const
+// Two real rows a and b are transformed at once as z = a + ib, then split
+// using A[k] = (Z[k] + Z*[n-k]) / 2 and B[k] = (Z[k] - Z*[n-k]) / 2i.
+void FFTCpu::calculateRealFourierInto(const float *input, Complex *fourier)
 {
-    const float dir = inverse ? 1.0 : -1.0;
+    if (m_layout != HalfSpectrum) {
+        FT::calculateRealFourierInto(input, fourier);
+        return;
+    }
+
+    const int spectrumCols = m_spectrumCols;
+
+    if (!IS_POWER_OF_TWO(m_rows) || !IS_POWER_OF_TWO(m_cols)) {
+        qWarning("Image width or height is not power of 2! (%dx%d)", m_cols, m_rows);
+        memset(fourier, 0, spectrumSize() * sizeof(Complex));
+        return;
+    }
+
+    QSharedPointer<const FFTPlan> rowPlan = FFTPlan::plan(m_cols, false);
+    QSharedPointer<const FFTPlan> colPlan = FFTPlan::plan(m_rows, false);
+    prepareScratch();
 
-    revbinPermute(vector, n);
-    unsigned ldn = log2(n);
+    Parallel::forRangeIndexed((m_rows + 1) / 2, kGrain, m_threadCount, [&](int worker, int begin, int end) {
+        float *real = workerScratch(worker, 4 * m_cols);
+        float *imag = real + m_cols;
+        float *work = imag + m_cols;
 
-    for (unsigned ldm = 1; ldm <= ldn; ++ldm) {
-        unsigned m = qPow(2, ldm);
-        unsigned mh = m / 2;
+        for (int pair = begin; pair < end; ++pair) {
+            const int y = 2 * pair;
+            const float *a = &input[y * m_cols];
+            const float *b = (y + 1 < m_rows) ? a + m_cols : 0;
 
-        for (unsigned r = 0; r < n; r += m) {
-            for (unsigned j = 0; j < mh; ++j) {
-                float angle = dir * 2.0 * (float)M_PI * (float)j / (float)m;
+            memcpy(real, a, m_cols * sizeof(float));
+            if (b)
+                memcpy(imag, b, m_cols * sizeof(float));
+            else
+                memset(imag, 0, m_cols * sizeof(float));
 
-                float ereal = qCos(angle);
-                float eimag = qSin(angle);
+            fft1D(real, imag, work, *rowPlan);
 
-                Complex v = vector[r + j + mh];
-                float vreal = v.real;
-                float vimag = v.imag;
-                v.real = vreal * ereal - vimag * eimag;
-                v.imag = vimag * ereal + vreal * eimag;
+            Complex *rowA = &fourier[y * spectrumCols];
+            Complex *rowB = b ? rowA + spectrumCols : 0;
+            for (int k = 0; k < spectrumCols; ++k) {
+                const int km = (m_cols - k) & (m_cols - 1);
 
-                Complex u = vector[r + j];
-                vector[r + j].real = u.real + v.real;
-                vector[r + j].imag = u.imag + v.imag;
-                vector[r + j + mh].real = u.real - v.real;
-                vector[r + j + mh].imag = u.imag - v.imag;
+                rowA[k].real = 0.5 * (real[k] + real[km]);
+                rowA[k].imag = 0.5 * (imag[k] - imag[km]);
+                if (rowB) {
+                    rowB[k].real = 0.5 * (imag[k] + imag[km]);
+                    rowB[k].imag = -0.5 * (real[k] - real[km]);
+                }
             }
         }
-    }
+    });
+
+    columnPass(&fourier, 1, spectrumCols, *colPlan, 1.0);
 }
 
-void FFTCpu::revbinPermute(Complex *vector, unsigned n) const
+void FFTCpu::calculateRealInverseInto(const Complex *spectrum, float *output)
 {
-    if (n <= 2)
+    if (m_layout != HalfSpectrum) {
+        FT::calculateRealInverseInto(spectrum, output);
         return;
+    }
 
-    unsigned ldn = log2(n);
-    for (unsigned x = 0; x < n - 1; ++x) {
-        unsigned r = revbin(x, ldn);
-        if (r > x) {
-            Complex tmp = vector[x];
-            vector[x] = vector[r];
-            vector[r] = tmp;
-        }
+    const int size = m_rows * m_cols;
+    const int spectrumCols = m_spectrumCols;
+    const float norm = 1.0 / size;
+
+    if (!IS_POWER_OF_TWO(m_rows) || !IS_POWER_OF_TWO(m_cols)) {
+        qWarning("Image width or height is not power of 2! (%dx%d)", m_cols, m_rows);
+        memset(output, 0, size * sizeof(float));
+        return;
     }
+
+    QSharedPointer<const FFTPlan> rowPlan = FFTPlan::plan(m_cols, true);
+    QSharedPointer<const FFTPlan> colPlan = FFTPlan::plan(m_rows, true);
+    prepareScratch();
+
+    Complex *columns = m_pool->acquire<Complex>(spectrumSize());
+    memcpy(columns, spectrum, spectrumSize() * sizeof(Complex));
+    columnPass(&columns, 1, spectrumCols, *colPlan, 1.0);
+    const Complex *rows = columns;
+
+    // Every row is now the Hermitian spectrum of a real row; two of them are
+    // rebuilt to full length and inverted together as A + iB.
+    Parallel::forRangeIndexed((m_rows + 1) / 2, kGrain, m_threadCount, [&](int worker, int begin, int end) {
+        float *real = workerScratch(worker, 4 * m_cols);
+        float *imag = real + m_cols;
+        float *work = imag + m_cols;
+
+        for (int pair = begin; pair < end; ++pair) {
+            const int y = 2 * pair;
+            const Complex *rowA = &rows[y * spectrumCols];
+            const Complex *rowB = (y + 1 < m_rows) ? rowA + spectrumCols : 0;
+
+            for (int k = 0; k < m_cols; ++k) {
+                Complex a, b;
+                if (k < spectrumCols) {
+                    a = rowA[k];
+                    if (rowB)
+                        b = rowB[k];
+                } else {
+                    a = Complex(rowA[m_cols - k].real, -rowA[m_cols - k].imag);
+                    if (rowB)
+                        b = Complex(rowB[m_cols - k].real, -rowB[m_cols - k].imag);
+                }
+
+                real[k] = a.real - b.imag;
+                imag[k] = a.imag + b.real;
+            }
+
+            fft1D(real, imag, work, *rowPlan);
+
+            float *outA = &output[y * m_cols];
+            for (int x = 0; x < m_cols; ++x)
+                outA[x] = real[x] * norm;
+
+            if (rowB) {
+                float *outB = outA + m_cols;
+                for (int x = 0; x < m_cols; ++x)
+                    outB[x] = imag[x] * norm;
+            }
+        }
+    });
+
+    m_pool->release(columns);
+}
+
+// Columns are transformed kTile at a time: a tile is transposed into
+// contiguous split buffers, transformed, and transposed back. Every copy
+// reads or writes whole cache lines instead of striding by a full row per
+// element, and the working set of a tile stays in cache. The tiles of all
+// count images are handed out together.
+void FFTCpu::columnPass(Complex *const *images, int count, int cols, const FFTPlan &plan, float norm)
+{
+    const int tiles = (cols + kTile - 1) / kTile;
+    const int grain = qMax(1, count * tiles / (4 * m_threadCount));
+
+    Parallel::forRangeIndexed(count * tiles, grain, m_threadCount, [&](int worker, int begin, int end) {
+        float *tileReal = workerScratch(worker, 2 * (kTile + 1) * m_rows);
+        float *tileImag = tileReal + kTile * m_rows;
+        float *work = tileImag + kTile * m_rows;
+
+        for (int i = begin; i < end; ++i) {
+            Complex *data = images[i / tiles];
+            const int tile = i % tiles;
+            const int x0 = tile * kTile;
+            const int width = qMin(kTile, cols - x0);
+
+            for (int y = 0; y < m_rows; ++y) {
+                const Complex *row = &data[x0 + y * cols];
+                for (int x = 0; x < width; ++x) {
+                    tileReal[x * m_rows + y] = row[x].real;
+                    tileImag[x * m_rows + y] = row[x].imag;
+                }
+            }
+
+            for (int x = 0; x < width; ++x)
+                fft1D(&tileReal[x * m_rows], &tileImag[x * m_rows], work, plan);
+
+            for (int y = 0; y < m_rows; ++y) {
+                Complex *row = &data[x0 + y * cols];
+                for (int x = 0; x < width; ++x) {
+                    row[x].real = tileReal[x * m_rows + y] * norm;
+                    row[x].imag = tileImag[x * m_rows + y] * norm;
+                }
+            }
+        }
+    });
 }
 
-inline int FFTCpu::revbin(unsigned x, unsigned ldn) const
+// One aligned scratch buffer per thread of a pass, taken from the pool and
+// kept between calls so that repeated transforms of one size do not
+// allocate. The outer vector is only resized here, before the workers start.
+void FFTCpu::prepareScratch()
 {
-    unsigned r = 0;
+    if (m_scratch.size() < m_threadCount)
+        m_scratch.resize(m_threadCount);
+}
 
-    while (ldn-- > 0) {
-        r = r << 1;
-        r = r + (x & 1);
-        x = x >> 1;
+float *FFTCpu::workerScratch(int worker, int size)
+{
+    QPair<float *, int> &buffer = m_scratch[worker];
+    if (buffer.second < size) {
+        m_pool->release(buffer.first);
+        buffer.first = m_pool->acquire<float>(size);
+        buffer.second = size;
+    }
+
+    return buffer.first;
+}
+
+// Short rows and columns go to a fixed-size codelet when there is one
+void FFTCpu::fft1D(float *real, float *imag, float *work, const FFTPlan &plan) const
+{
+    if (FFTCodelets::Function codelet = FFTCodelets::find(plan.size(), plan.isInverse())) {
+        codelet(real, imag, work);
+        return;
     }
 
-    return r;
+    revbinPermute(real, imag, plan);
+    FFTKernels::butterflies(real, imag, plan);
+}
+
+void FFTCpu::revbinPermute(float *real, float *imag, const FFTPlan &plan) const
+{
+    const unsigned n = plan.size();
+    if (n <= 2)
+        return;
+
+    const unsigned *revbin = plan.revbinTable();
+    for (unsigned x = 0; x < n - 1; ++x) {
+        unsigned r = revbin[x];
+        if (r > x) {
+            float tmp = real[x];
+            real[x] = real[r];
+            real[r] = tmp;
+
+            tmp = imag[x];
+            imag[x] = imag[r];
+            imag[r] = tmp;
+        }
+    }
 }
@@ -1,19 +1,39 @@
 #ifndef FFTCPU_H
 #define FFTCPU_H
 
+#include <QPair>
+#include <QVector>
+
 #include "ft.h"
 
+class FFTPlan;
+
 class FFTCpu : public FT {
 public:
     explicit FFTCpu(FImage *image, QObject *parent = 0);
+    FFTCpu(FImage *image, SpectrumLayout layout, QObject *parent = 0);
     ~FFTCpu();
 
+    QString variant() const;
+
+protected:
+    // Transforms n split points in place; work holds 2n scratch floats
+    virtual void fft1D(float *, float *, float *, const FFTPlan &) const;
+    void revbinPermute(float *, float *, const FFTPlan &) const;
+
 private:
     Complex *calculateFourier(Complex *input, bool inverse = false);
+    void calculateFourierInto(const Complex *input, Complex *output, bool inverse);
+    void calculateFourierBatchInto(const Complex *const *inputs, Complex *const *outputs,
+                                   int count, bool inverse);
+    void calculateRealFourierInto(const float *input, Complex *output);
+    void calculateRealInverseInto(const Complex *spectrum, float *output);
+
+    void columnPass(Complex *const *, int, int, const FFTPlan &, float);
+    void prepareScratch();
+    float *workerScratch(int worker, int size);
 
-    void fft1D(Complex *, unsigned, bool) const;
-    void revbinPermute(Complex *, unsigned) const;
-    inline int revbin(unsigned, unsigned) const;
+    QVector<QPair<float *, int> > m_scratch;
 };
 
 #endif // FFTCPU_H
@@ -24,28 +24,45 @@ FFTGpu::~FFTGpu()
 }
 
 Complex *FFTGpu::calculateFourier(Complex *input, bool inverse)
+{
+    Complex *fourier = new Complex[m_cols * m_rows];
+    calculateFourierBatchInto(&input, &fourier, 1, inverse);
+
+    return fourier;
+}
+
+// The whole batch is uploaded as one buffer, and each pass is a single
+// NDRange over the rows or columns of all its images.
+void FFTGpu::calculateFourierBatchInto(const Complex *const *inputs, Complex *const *outputs,
+                                       int count, bool inverse)
 {
     const unsigned size = m_cols * m_rows;
+    const unsigned batchSize = count * size;
     const float dir = inverse ? 1.0 : -1.0;
     const float norm = inverse ? 1.0 / size : 1.0;
     cl_int clError = 0;
 
     if (!IS_POWER_OF_TWO(m_rows) || !IS_POWER_OF_TWO(m_cols)) {
         qWarning("Image width or height is not power of 2! (%dx%d)", m_cols, m_rows);
-        return new Complex[size];
+        for (int i = 0; i < count; ++i)
+            memset(outputs[i], 0, size * sizeof(Complex));
+        return;
     }
 
-    cl_float2 *fourierBuffer = new cl_float2[size];
-    for (unsigned i = 0; i < size; ++i) {
-        fourierBuffer[i].s[0] = input[i].real;
-        fourierBuffer[i].s[1] = input[i].imag;
+    cl_float2 *fourierBuffer = new cl_float2[batchSize];
+    for (int i = 0; i < count; ++i) {
+        cl_float2 *buffer = fourierBuffer + i * size;
+        for (unsigned j = 0; j < size; ++j) {
+            buffer[j].s[0] = inputs[i][j].real;
+            buffer[j].s[1] = inputs[i][j].imag;
+        }
     }
 
-    cl_mem clFourier = m_gpu->setCommonKernelArg<cl_float2>(fourierBuffer, size, 0, "fft1DRow");
+    cl_mem clFourier = m_gpu->setCommonKernelArg<cl_float2>(fourierBuffer, batchSize, 0, "fft1DRow");
     m_gpu->setInputKernelArg<float>(&dir, "fft1DRow");
 
     cl_uint dim = 1;
-    size_t globalWorkGroupSize[] = { (size_t)m_rows, 0, 0 };
+    size_t globalWorkGroupSize[] = { (size_t)count * m_rows, 0, 0 };
 
     clError |= clEnqueueNDRangeKernel(m_gpu->getCommandQueue(),
                                       m_gpu->getKernel("fft1DRow"),
@@ -54,11 +71,11 @@ Complex *FFTGpu::calculateFourier(Complex *input, bool inverse)
                                       globalWorkGroupSize,
                                       0, 0, 0, 0);
 
-    m_gpu->setCommonKernelArg<cl_float2>(fourierBuffer, size, clFourier, "fft1DCol");
+    m_gpu->setCommonKernelArg<cl_float2>(fourierBuffer, batchSize, clFourier, "fft1DCol");
     m_gpu->setInputKernelArg<float>(&dir, "fft1DCol");
     m_gpu->setInputKernelArg<float>(&norm, "fft1DCol");
 
-    globalWorkGroupSize[0] = (size_t)m_cols;
+    globalWorkGroupSize[0] = (size_t)count * m_cols;
     clError |= clEnqueueNDRangeKernel(m_gpu->getCommandQueue(),
                                       m_gpu->getKernel("fft1DCol"),
                                       dim,
@@ -67,17 +84,22 @@ Complex *FFTGpu::calculateFourier(Complex *input, bool inverse)
                                       0, 0, 0, 0);
     clError |= clFinish(m_gpu->getCommandQueue());
 
+    // Drops the kernel arguments, and reads fourierBuffer back, even after
+    // an error, so that the next transform starts from none
+    m_gpu->release();
+
     if (clError != CL_SUCCESS) {
         qWarning("[ERROR] Unable to execute OpenCL Kernel: %d", clError);
-        return new Complex[size];
+        for (int i = 0; i < count; ++i)
+            memset(outputs[i], 0, size * sizeof(Complex));
+        delete[] fourierBuffer;
+        return;
     }
 
-    m_gpu->release();
-
-    Complex *fourier = new Complex[size];
-    for (unsigned i = 0; i < size; ++i)
-        fourier[i] = Complex(fourierBuffer[i].s[0], fourierBuffer[i].s[1]);
-    delete fourierBuffer;
-
-    return fourier;
+    for (int i = 0; i < count; ++i) {
+        const cl_float2 *buffer = fourierBuffer + i * size;
+        for (unsigned j = 0; j < size; ++j)
+            outputs[i][j] = Complex(buffer[j].s[0], buffer[j].s[1]);
+    }
+    delete[] fourierBuffer;
 }
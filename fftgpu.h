@@ -12,6 +12,8 @@ public:
 
 private:
     Complex *calculateFourier(Complex *input, bool inverse = false);
+    void calculateFourierBatchInto(const Complex *const *inputs, Complex *const *outputs,
+                                   int count, bool inverse);
 
     QScopedPointer<GPU> m_gpu;
 };
@@ -0,0 +1,832 @@
+#include "fftkernels.h"
+
+#include "fftplan.h"
+
+#include <string.h>
+
+#include <QAtomicInt>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FFTKERNELS_X86
+#include <immintrin.h>
+#endif
+
+#if defined(FFTKERNELS_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+typedef void (*Radix2Kernel)(float *, float *, const float *, const float *, unsigned, unsigned);
+typedef void (*Radix4Kernel)(float *, float *, const float *, const float *,
+                             const float *, const float *, unsigned, unsigned);
+
+static FFTKernels::Isa detectIsa()
+{
+#if defined(FFTKERNELS_X86) && defined(__GNUC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return FFTKernels::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return FFTKernels::AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return FFTKernels::SSE2;
+#elif defined(FFTKERNELS_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    const bool sse2 = info[3] & (1 << 26);
+    const bool fma = info[2] & (1 << 12);
+    const bool osxsave = info[2] & (1 << 27);
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+
+    if (maxLeaf >= 7 && (xcr0 & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        if ((xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16)))
+            return FFTKernels::AVX512;
+        if (fma && (info[1] & (1 << 5)))
+            return FFTKernels::AVX2;
+    }
+    if (sse2)
+        return FFTKernels::SSE2;
+#endif
+    return FFTKernels::Scalar;
+}
+
+// ISACOUNT until setIsa() picks a set, for the best supported one; atomic
+// since transforms on any thread read it
+static QAtomicInt s_isa(FFTKernels::ISACOUNT);
+
+FFTKernels::Isa FFTKernels::supportedIsa()
+{
+    static const Isa supported = detectIsa();
+    return supported;
+}
+
+FFTKernels::Isa FFTKernels::isa()
+{
+    const int active = s_isa.loadAcquire();
+    return active == ISACOUNT ? supportedIsa() : Isa(active);
+}
+
+void FFTKernels::setIsa(Isa isa)
+{
+    s_isa.storeRelease(isa > supportedIsa() ? supportedIsa() : isa);
+}
+
+const char *FFTKernels::isaName(Isa isa)
+{
+    switch (isa) {
+    case Scalar:
+        return "scalar";
+    case SSE2:
+        return "sse2";
+    case AVX2:
+        return "avx2";
+    case AVX512:
+        return "avx512";
+    default:
+        return "unknown";
+    }
+}
+
+static void radix2Scalar(float *re, float *im, const float *wr, const float *wi, unsigned n, unsigned mh)
+{
+    for (unsigned r = 0; r < n; r += 2 * mh) {
+        for (unsigned j = 0; j < mh; ++j) {
+            const unsigned a = r + j;
+            const unsigned b = a + mh;
+
+            const float tr = re[b] * wr[j] - im[b] * wi[j];
+            const float ti = im[b] * wr[j] + re[b] * wi[j];
+
+            re[b] = re[a] - tr;
+            im[b] = im[a] - ti;
+            re[a] += tr;
+            im[a] += ti;
+        }
+    }
+}
+
+// Two consecutive radix-2 stages (mh and 2 * mh) fused into one pass over
+// the data; w1 are the twiddles of stage mh and w2 of stage 2 * mh.
+static void radix4Scalar(float *re, float *im, const float *w1r, const float *w1i,
+                         const float *w2r, const float *w2i, unsigned n, unsigned mh)
+{
+    for (unsigned r = 0; r < n; r += 4 * mh) {
+        for (unsigned j = 0; j < mh; ++j) {
+            float *r0 = re + r + j;
+            float *i0 = im + r + j;
+
+            float tr = r0[mh] * w1r[j] - i0[mh] * w1i[j];
+            float ti = i0[mh] * w1r[j] + r0[mh] * w1i[j];
+            const float y0r = r0[0] + tr, y0i = i0[0] + ti;
+            const float y1r = r0[0] - tr, y1i = i0[0] - ti;
+
+            tr = r0[3 * mh] * w1r[j] - i0[3 * mh] * w1i[j];
+            ti = i0[3 * mh] * w1r[j] + r0[3 * mh] * w1i[j];
+            const float y2r = r0[2 * mh] + tr, y2i = i0[2 * mh] + ti;
+            const float y3r = r0[2 * mh] - tr, y3i = i0[2 * mh] - ti;
+
+            tr = y2r * w2r[j] - y2i * w2i[j];
+            ti = y2i * w2r[j] + y2r * w2i[j];
+            r0[0] = y0r + tr;
+            i0[0] = y0i + ti;
+            r0[2 * mh] = y0r - tr;
+            i0[2 * mh] = y0i - ti;
+
+            tr = y3r * w2r[j + mh] - y3i * w2i[j + mh];
+            ti = y3i * w2r[j + mh] + y3r * w2i[j + mh];
+            r0[mh] = y1r + tr;
+            i0[mh] = y1i + ti;
+            r0[3 * mh] = y1r - tr;
+            i0[3 * mh] = y1i - ti;
+        }
+    }
+}
+
+#ifdef FFTKERNELS_X86
+
+// The vector kernels mirror the scalar ones with j stepping by the vector
+// width; they are only used for stages where mh is a multiple of it.
+
+TARGET_SSE2 static void radix2SSE2(float *re, float *im, const float *wr, const float *wi, unsigned n, unsigned mh)
+{
+    for (unsigned r = 0; r < n; r += 2 * mh) {
+        for (unsigned j = 0; j < mh; j += 4) {
+            float *ar = re + r + j, *ai = im + r + j;
+            float *br = ar + mh, *bi = ai + mh;
+
+            const __m128 vwr = _mm_loadu_ps(wr + j), vwi = _mm_loadu_ps(wi + j);
+            const __m128 vbr = _mm_loadu_ps(br), vbi = _mm_loadu_ps(bi);
+            const __m128 var = _mm_loadu_ps(ar), vai = _mm_loadu_ps(ai);
+
+            const __m128 tr = _mm_sub_ps(_mm_mul_ps(vbr, vwr), _mm_mul_ps(vbi, vwi));
+            const __m128 ti = _mm_add_ps(_mm_mul_ps(vbi, vwr), _mm_mul_ps(vbr, vwi));
+
+            _mm_storeu_ps(ar, _mm_add_ps(var, tr));
+            _mm_storeu_ps(ai, _mm_add_ps(vai, ti));
+            _mm_storeu_ps(br, _mm_sub_ps(var, tr));
+            _mm_storeu_ps(bi, _mm_sub_ps(vai, ti));
+        }
+    }
+}
+
+TARGET_SSE2 static void radix4SSE2(float *re, float *im, const float *w1r, const float *w1i,
+                                   const float *w2r, const float *w2i, unsigned n, unsigned mh)
+{
+    for (unsigned r = 0; r < n; r += 4 * mh) {
+        for (unsigned j = 0; j < mh; j += 4) {
+            float *r0 = re + r + j, *i0 = im + r + j;
+
+            const __m128 a1r = _mm_loadu_ps(w1r + j), a1i = _mm_loadu_ps(w1i + j);
+            const __m128 a2r = _mm_loadu_ps(w2r + j), a2i = _mm_loadu_ps(w2i + j);
+            const __m128 a3r = _mm_loadu_ps(w2r + j + mh), a3i = _mm_loadu_ps(w2i + j + mh);
+
+            const __m128 x0r = _mm_loadu_ps(r0), x0i = _mm_loadu_ps(i0);
+            const __m128 x1r = _mm_loadu_ps(r0 + mh), x1i = _mm_loadu_ps(i0 + mh);
+            const __m128 x2r = _mm_loadu_ps(r0 + 2 * mh), x2i = _mm_loadu_ps(i0 + 2 * mh);
+            const __m128 x3r = _mm_loadu_ps(r0 + 3 * mh), x3i = _mm_loadu_ps(i0 + 3 * mh);
+
+            __m128 tr = _mm_sub_ps(_mm_mul_ps(x1r, a1r), _mm_mul_ps(x1i, a1i));
+            __m128 ti = _mm_add_ps(_mm_mul_ps(x1i, a1r), _mm_mul_ps(x1r, a1i));
+            const __m128 y0r = _mm_add_ps(x0r, tr), y0i = _mm_add_ps(x0i, ti);
+            const __m128 y1r = _mm_sub_ps(x0r, tr), y1i = _mm_sub_ps(x0i, ti);
+
+            tr = _mm_sub_ps(_mm_mul_ps(x3r, a1r), _mm_mul_ps(x3i, a1i));
+            ti = _mm_add_ps(_mm_mul_ps(x3i, a1r), _mm_mul_ps(x3r, a1i));
+            const __m128 y2r = _mm_add_ps(x2r, tr), y2i = _mm_add_ps(x2i, ti);
+            const __m128 y3r = _mm_sub_ps(x2r, tr), y3i = _mm_sub_ps(x2i, ti);
+
+            tr = _mm_sub_ps(_mm_mul_ps(y2r, a2r), _mm_mul_ps(y2i, a2i));
+            ti = _mm_add_ps(_mm_mul_ps(y2i, a2r), _mm_mul_ps(y2r, a2i));
+            _mm_storeu_ps(r0, _mm_add_ps(y0r, tr));
+            _mm_storeu_ps(i0, _mm_add_ps(y0i, ti));
+            _mm_storeu_ps(r0 + 2 * mh, _mm_sub_ps(y0r, tr));
+            _mm_storeu_ps(i0 + 2 * mh, _mm_sub_ps(y0i, ti));
+
+            tr = _mm_sub_ps(_mm_mul_ps(y3r, a3r), _mm_mul_ps(y3i, a3i));
+            ti = _mm_add_ps(_mm_mul_ps(y3i, a3r), _mm_mul_ps(y3r, a3i));
+            _mm_storeu_ps(r0 + mh, _mm_add_ps(y1r, tr));
+            _mm_storeu_ps(i0 + mh, _mm_add_ps(y1i, ti));
+            _mm_storeu_ps(r0 + 3 * mh, _mm_sub_ps(y1r, tr));
+            _mm_storeu_ps(i0 + 3 * mh, _mm_sub_ps(y1i, ti));
+        }
+    }
+}
+
+TARGET_AVX2 static void radix2AVX2(float *re, float *im, const float *wr, const float *wi, unsigned n, unsigned mh)
+{
+    for (unsigned r = 0; r < n; r += 2 * mh) {
+        for (unsigned j = 0; j < mh; j += 8) {
+            float *ar = re + r + j, *ai = im + r + j;
+            float *br = ar + mh, *bi = ai + mh;
+
+            const __m256 vwr = _mm256_loadu_ps(wr + j), vwi = _mm256_loadu_ps(wi + j);
+            const __m256 vbr = _mm256_loadu_ps(br), vbi = _mm256_loadu_ps(bi);
+            const __m256 var = _mm256_loadu_ps(ar), vai = _mm256_loadu_ps(ai);
+
+            const __m256 tr = _mm256_fmsub_ps(vbr, vwr, _mm256_mul_ps(vbi, vwi));
+            const __m256 ti = _mm256_fmadd_ps(vbi, vwr, _mm256_mul_ps(vbr, vwi));
+
+            _mm256_storeu_ps(ar, _mm256_add_ps(var, tr));
+            _mm256_storeu_ps(ai, _mm256_add_ps(vai, ti));
+            _mm256_storeu_ps(br, _mm256_sub_ps(var, tr));
+            _mm256_storeu_ps(bi, _mm256_sub_ps(vai, ti));
+        }
+    }
+}
+
+TARGET_AVX2 static void radix4AVX2(float *re, float *im, const float *w1r, const float *w1i,
+                                   const float *w2r, const float *w2i, unsigned n, unsigned mh)
+{
+    for (unsigned r = 0; r < n; r += 4 * mh) {
+        for (unsigned j = 0; j < mh; j += 8) {
+            float *r0 = re + r + j, *i0 = im + r + j;
+
+            const __m256 a1r = _mm256_loadu_ps(w1r + j), a1i = _mm256_loadu_ps(w1i + j);
+            const __m256 a2r = _mm256_loadu_ps(w2r + j), a2i = _mm256_loadu_ps(w2i + j);
+            const __m256 a3r = _mm256_loadu_ps(w2r + j + mh), a3i = _mm256_loadu_ps(w2i + j + mh);
+
+            const __m256 x0r = _mm256_loadu_ps(r0), x0i = _mm256_loadu_ps(i0);
+            const __m256 x1r = _mm256_loadu_ps(r0 + mh), x1i = _mm256_loadu_ps(i0 + mh);
+            const __m256 x2r = _mm256_loadu_ps(r0 + 2 * mh), x2i = _mm256_loadu_ps(i0 + 2 * mh);
+            const __m256 x3r = _mm256_loadu_ps(r0 + 3 * mh), x3i = _mm256_loadu_ps(i0 + 3 * mh);
+
+            __m256 tr = _mm256_fmsub_ps(x1r, a1r, _mm256_mul_ps(x1i, a1i));
+            __m256 ti = _mm256_fmadd_ps(x1i, a1r, _mm256_mul_ps(x1r, a1i));
+            const __m256 y0r = _mm256_add_ps(x0r, tr), y0i = _mm256_add_ps(x0i, ti);
+            const __m256 y1r = _mm256_sub_ps(x0r, tr), y1i = _mm256_sub_ps(x0i, ti);
+
+            tr = _mm256_fmsub_ps(x3r, a1r, _mm256_mul_ps(x3i, a1i));
+            ti = _mm256_fmadd_ps(x3i, a1r, _mm256_mul_ps(x3r, a1i));
+            const __m256 y2r = _mm256_add_ps(x2r, tr), y2i = _mm256_add_ps(x2i, ti);
+            const __m256 y3r = _mm256_sub_ps(x2r, tr), y3i = _mm256_sub_ps(x2i, ti);
+
+            tr = _mm256_fmsub_ps(y2r, a2r, _mm256_mul_ps(y2i, a2i));
+            ti = _mm256_fmadd_ps(y2i, a2r, _mm256_mul_ps(y2r, a2i));
+            _mm256_storeu_ps(r0, _mm256_add_ps(y0r, tr));
+            _mm256_storeu_ps(i0, _mm256_add_ps(y0i, ti));
+            _mm256_storeu_ps(r0 + 2 * mh, _mm256_sub_ps(y0r, tr));
+            _mm256_storeu_ps(i0 + 2 * mh, _mm256_sub_ps(y0i, ti));
+
+            tr = _mm256_fmsub_ps(y3r, a3r, _mm256_mul_ps(y3i, a3i));
+            ti = _mm256_fmadd_ps(y3i, a3r, _mm256_mul_ps(y3r, a3i));
+            _mm256_storeu_ps(r0 + mh, _mm256_add_ps(y1r, tr));
+            _mm256_storeu_ps(i0 + mh, _mm256_add_ps(y1i, ti));
+            _mm256_storeu_ps(r0 + 3 * mh, _mm256_sub_ps(y1r, tr));
+            _mm256_storeu_ps(i0 + 3 * mh, _mm256_sub_ps(y1i, ti));
+        }
+    }
+}
+
+TARGET_AVX512 static void radix2AVX512(float *re, float *im, const float *wr, const float *wi, unsigned n, unsigned mh)
+{
+    for (unsigned r = 0; r < n; r += 2 * mh) {
+        for (unsigned j = 0; j < mh; j += 16) {
+            float *ar = re + r + j, *ai = im + r + j;
+            float *br = ar + mh, *bi = ai + mh;
+
+            const __m512 vwr = _mm512_loadu_ps(wr + j), vwi = _mm512_loadu_ps(wi + j);
+            const __m512 vbr = _mm512_loadu_ps(br), vbi = _mm512_loadu_ps(bi);
+            const __m512 var = _mm512_loadu_ps(ar), vai = _mm512_loadu_ps(ai);
+
+            const __m512 tr = _mm512_fmsub_ps(vbr, vwr, _mm512_mul_ps(vbi, vwi));
+            const __m512 ti = _mm512_fmadd_ps(vbi, vwr, _mm512_mul_ps(vbr, vwi));
+
+            _mm512_storeu_ps(ar, _mm512_add_ps(var, tr));
+            _mm512_storeu_ps(ai, _mm512_add_ps(vai, ti));
+            _mm512_storeu_ps(br, _mm512_sub_ps(var, tr));
+            _mm512_storeu_ps(bi, _mm512_sub_ps(vai, ti));
+        }
+    }
+}
+
+TARGET_AVX512 static void radix4AVX512(float *re, float *im, const float *w1r, const float *w1i,
+                                       const float *w2r, const float *w2i, unsigned n, unsigned mh)
+{
+    for (unsigned r = 0; r < n; r += 4 * mh) {
+        for (unsigned j = 0; j < mh; j += 16) {
+            float *r0 = re + r + j, *i0 = im + r + j;
+
+            const __m512 a1r = _mm512_loadu_ps(w1r + j), a1i = _mm512_loadu_ps(w1i + j);
+            const __m512 a2r = _mm512_loadu_ps(w2r + j), a2i = _mm512_loadu_ps(w2i + j);
+            const __m512 a3r = _mm512_loadu_ps(w2r + j + mh), a3i = _mm512_loadu_ps(w2i + j + mh);
+
+            const __m512 x0r = _mm512_loadu_ps(r0), x0i = _mm512_loadu_ps(i0);
+            const __m512 x1r = _mm512_loadu_ps(r0 + mh), x1i = _mm512_loadu_ps(i0 + mh);
+            const __m512 x2r = _mm512_loadu_ps(r0 + 2 * mh), x2i = _mm512_loadu_ps(i0 + 2 * mh);
+            const __m512 x3r = _mm512_loadu_ps(r0 + 3 * mh), x3i = _mm512_loadu_ps(i0 + 3 * mh);
+
+            __m512 tr = _mm512_fmsub_ps(x1r, a1r, _mm512_mul_ps(x1i, a1i));
+            __m512 ti = _mm512_fmadd_ps(x1i, a1r, _mm512_mul_ps(x1r, a1i));
+            const __m512 y0r = _mm512_add_ps(x0r, tr), y0i = _mm512_add_ps(x0i, ti);
+            const __m512 y1r = _mm512_sub_ps(x0r, tr), y1i = _mm512_sub_ps(x0i, ti);
+
+            tr = _mm512_fmsub_ps(x3r, a1r, _mm512_mul_ps(x3i, a1i));
+            ti = _mm512_fmadd_ps(x3i, a1r, _mm512_mul_ps(x3r, a1i));
+            const __m512 y2r = _mm512_add_ps(x2r, tr), y2i = _mm512_add_ps(x2i, ti);
+            const __m512 y3r = _mm512_sub_ps(x2r, tr), y3i = _mm512_sub_ps(x2i, ti);
+
+            tr = _mm512_fmsub_ps(y2r, a2r, _mm512_mul_ps(y2i, a2i));
+            ti = _mm512_fmadd_ps(y2i, a2r, _mm512_mul_ps(y2r, a2i));
+            _mm512_storeu_ps(r0, _mm512_add_ps(y0r, tr));
+            _mm512_storeu_ps(i0, _mm512_add_ps(y0i, ti));
+            _mm512_storeu_ps(r0 + 2 * mh, _mm512_sub_ps(y0r, tr));
+            _mm512_storeu_ps(i0 + 2 * mh, _mm512_sub_ps(y0i, ti));
+
+            tr = _mm512_fmsub_ps(y3r, a3r, _mm512_mul_ps(y3i, a3i));
+            ti = _mm512_fmadd_ps(y3i, a3r, _mm512_mul_ps(y3r, a3i));
+            _mm512_storeu_ps(r0 + mh, _mm512_add_ps(y1r, tr));
+            _mm512_storeu_ps(i0 + mh, _mm512_add_ps(y1i, ti));
+            _mm512_storeu_ps(r0 + 3 * mh, _mm512_sub_ps(y1r, tr));
+            _mm512_storeu_ps(i0 + 3 * mh, _mm512_sub_ps(y1i, ti));
+        }
+    }
+}
+
+#endif // FFTKERNELS_X86
+
+static void selectKernels(FFTKernels::Isa isa, unsigned mh, Radix2Kernel *radix2, Radix4Kernel *radix4)
+{
+    *radix2 = radix2Scalar;
+    *radix4 = radix4Scalar;
+
+#ifdef FFTKERNELS_X86
+    if (isa >= FFTKernels::AVX512 && mh >= 16) {
+        *radix2 = radix2AVX512;
+        *radix4 = radix4AVX512;
+    } else if (isa >= FFTKernels::AVX2 && mh >= 8) {
+        *radix2 = radix2AVX2;
+        *radix4 = radix4AVX2;
+    } else if (isa >= FFTKernels::SSE2 && mh >= 4) {
+        *radix2 = radix2SSE2;
+        *radix4 = radix4SSE2;
+    }
+#else
+    Q_UNUSED(isa);
+    Q_UNUSED(mh);
+#endif
+}
+
+void FFTKernels::butterflies(float *real, float *imag, const FFTPlan &plan)
+{
+    const unsigned n = plan.size();
+    const Isa active = isa();
+
+    unsigned mh = 1;
+    while (mh < n) {
+        Radix2Kernel radix2;
+        Radix4Kernel radix4;
+        selectKernels(active, mh, &radix2, &radix4);
+
+        if (4 * mh <= n) {
+            radix4(real, imag, plan.twiddleReal(mh), plan.twiddleImag(mh),
+                   plan.twiddleReal(2 * mh), plan.twiddleImag(2 * mh), n, mh);
+            mh *= 4;
+        } else {
+            radix2(real, imag, plan.twiddleReal(mh), plan.twiddleImag(mh), n, mh);
+            mh *= 2;
+        }
+    }
+}
+
+// With bit-reversed input, the four quarters of a block of length L hold the
+// sub-transforms of x[4n], x[4n + 2], x[4n + 1] and x[4n + 3], in that order.
+void FFTKernels::radix4Butterflies(float *real, float *imag, const FFTPlan &plan)
+{
+    const unsigned n = plan.size();
+    const float dir = plan.isInverse() ? 1.0 : -1.0;
+    unsigned quarter = 1;
+
+    if (plan.log2Size() & 1) {
+        for (unsigned r = 0; r + 1 < n; r += 2) {
+            const float ar = real[r], ai = imag[r];
+            real[r] = ar + real[r + 1];
+            imag[r] = ai + imag[r + 1];
+            real[r + 1] = ar - real[r + 1];
+            imag[r + 1] = ai - imag[r + 1];
+        }
+        quarter = 2;
+    }
+
+    for (; 4 * quarter <= n; quarter *= 4) {
+        const unsigned length = 4 * quarter;
+        const float *w1r = plan.radix4Twiddles(quarter);
+        const float *w1i = w1r + quarter;
+        const float *w2r = w1i + quarter;
+        const float *w2i = w2r + quarter;
+        const float *w3r = w2i + quarter;
+        const float *w3i = w3r + quarter;
+
+        for (unsigned r = 0; r < n; r += length) {
+            float *r0 = real + r;
+            float *i0 = imag + r;
+            float *r1 = r0 + quarter, *i1 = i0 + quarter;
+            float *r2 = r1 + quarter, *i2 = i1 + quarter;
+            float *r3 = r2 + quarter, *i3 = i2 + quarter;
+
+            for (unsigned k = 0; k < quarter; ++k) {
+                const float b0r = r0[k], b0i = i0[k];
+                const float b1r = r2[k] * w1r[k] - i2[k] * w1i[k];
+                const float b1i = i2[k] * w1r[k] + r2[k] * w1i[k];
+                const float b2r = r1[k] * w2r[k] - i1[k] * w2i[k];
+                const float b2i = i1[k] * w2r[k] + r1[k] * w2i[k];
+                const float b3r = r3[k] * w3r[k] - i3[k] * w3i[k];
+                const float b3i = i3[k] * w3r[k] + r3[k] * w3i[k];
+
+                const float t0r = b0r + b2r, t0i = b0i + b2i;
+                const float t1r = b0r - b2r, t1i = b0i - b2i;
+                const float t2r = b1r + b3r, t2i = b1i + b3i;
+                // (b1 - b3) multiplied by W_4 = dir * i
+                const float t3r = -dir * (b1i - b3i);
+                const float t3i = dir * (b1r - b3r);
+
+                r0[k] = t0r + t2r;
+                i0[k] = t0i + t2i;
+                r1[k] = t1r + t3r;
+                i1[k] = t1i + t3i;
+                r2[k] = t0r - t2r;
+                i2[k] = t0i - t2i;
+                r3[k] = t1r - t3r;
+                i3[k] = t1i - t3i;
+            }
+        }
+    }
+}
+
+// Stockham stage with half-length m and stride s = n / 2m:
+//   y[q + s * 2p]       = x[q + s * p] + x[q + s * (p + m)]
+//   y[q + s * (2p + 1)] = (x[q + s * p] - x[q + s * (p + m)]) * W_2m^p
+// The vector versions step q by the vector width, so every load and store is
+// contiguous; they are used once s is a multiple of it.
+static void stockhamScalar(const float *xr, const float *xi, float *yr, float *yi,
+                           const float *wr, const float *wi, unsigned m, unsigned s)
+{
+    // The first stages have short q runs; walk p innermost instead
+    if (s < m) {
+        for (unsigned q = 0; q < s; ++q) {
+            for (unsigned p = 0; p < m; ++p) {
+                const unsigned a = q + s * p;
+                const unsigned b = a + s * m;
+                const unsigned y = q + 2 * s * p;
+
+                const float tr = xr[a] - xr[b];
+                const float ti = xi[a] - xi[b];
+                yr[y] = xr[a] + xr[b];
+                yi[y] = xi[a] + xi[b];
+                yr[y + s] = tr * wr[p] - ti * wi[p];
+                yi[y + s] = ti * wr[p] + tr * wi[p];
+            }
+        }
+        return;
+    }
+
+    for (unsigned p = 0; p < m; ++p) {
+        const float *ar = xr + s * p, *ai = xi + s * p;
+        const float *br = ar + s * m, *bi = ai + s * m;
+        float *sr = yr + 2 * s * p, *si = yi + 2 * s * p;
+
+        for (unsigned q = 0; q < s; ++q) {
+            const float tr = ar[q] - br[q];
+            const float ti = ai[q] - bi[q];
+            sr[q] = ar[q] + br[q];
+            si[q] = ai[q] + bi[q];
+            sr[q + s] = tr * wr[p] - ti * wi[p];
+            si[q + s] = ti * wr[p] + tr * wi[p];
+        }
+    }
+}
+
+// Two Stockham stages fused: half-length 2m and m, stride s = n / 4m.
+// With a_k = x[q + s * (p + k * m)] and w = W_4m:
+//   y[q + s * 4p]       = (a0 + a2) + (a1 + a3)
+//   y[q + s * (4p + 1)] = ((a0 - a2) + j * (a1 - a3)) * w^p
+//   y[q + s * (4p + 2)] = ((a0 + a2) - (a1 + a3)) * w^2p
+//   y[q + s * (4p + 3)] = ((a0 - a2) - j * (a1 - a3)) * w^3p
+// where j = -i for the forward and i for the inverse transform.
+static void stockham4Scalar(const float *xr, const float *xi, float *yr, float *yi,
+                            const float *w, float dir, unsigned m, unsigned s)
+{
+    const float *w1r = w, *w1i = w + m;
+    const float *w2r = w + 2 * m, *w2i = w + 3 * m;
+    const float *w3r = w + 4 * m, *w3i = w + 5 * m;
+
+    for (unsigned p = 0; p < m; ++p) {
+        for (unsigned q = 0; q < s; ++q) {
+            const unsigned a = q + s * p;
+            const unsigned y = q + 4 * s * p;
+
+            const float b0r = xr[a] + xr[a + 2 * s * m], b0i = xi[a] + xi[a + 2 * s * m];
+            const float b1r = xr[a] - xr[a + 2 * s * m], b1i = xi[a] - xi[a + 2 * s * m];
+            const float c0r = xr[a + s * m] + xr[a + 3 * s * m];
+            const float c0i = xi[a + s * m] + xi[a + 3 * s * m];
+            // (a1 - a3) multiplied by j
+            const float c1r = -dir * (xi[a + s * m] - xi[a + 3 * s * m]);
+            const float c1i = dir * (xr[a + s * m] - xr[a + 3 * s * m]);
+
+            float tr = b1r + c1r, ti = b1i + c1i;
+            yr[y] = b0r + c0r;
+            yi[y] = b0i + c0i;
+            yr[y + s] = tr * w1r[p] - ti * w1i[p];
+            yi[y + s] = ti * w1r[p] + tr * w1i[p];
+
+            tr = b0r - c0r;
+            ti = b0i - c0i;
+            yr[y + 2 * s] = tr * w2r[p] - ti * w2i[p];
+            yi[y + 2 * s] = ti * w2r[p] + tr * w2i[p];
+
+            tr = b1r - c1r;
+            ti = b1i - c1i;
+            yr[y + 3 * s] = tr * w3r[p] - ti * w3i[p];
+            yi[y + 3 * s] = ti * w3r[p] + tr * w3i[p];
+        }
+    }
+}
+
+#ifdef FFTKERNELS_X86
+
+TARGET_SSE2 static void stockhamSSE2(const float *xr, const float *xi, float *yr, float *yi,
+                                     const float *wr, const float *wi, unsigned m, unsigned s)
+{
+    for (unsigned p = 0; p < m; ++p) {
+        const float *ar = xr + s * p, *ai = xi + s * p;
+        const float *br = ar + s * m, *bi = ai + s * m;
+        float *sr = yr + 2 * s * p, *si = yi + 2 * s * p;
+        const __m128 vwr = _mm_set1_ps(wr[p]), vwi = _mm_set1_ps(wi[p]);
+
+        for (unsigned q = 0; q < s; q += 4) {
+            const __m128 var = _mm_loadu_ps(ar + q), vai = _mm_loadu_ps(ai + q);
+            const __m128 vbr = _mm_loadu_ps(br + q), vbi = _mm_loadu_ps(bi + q);
+            const __m128 tr = _mm_sub_ps(var, vbr), ti = _mm_sub_ps(vai, vbi);
+
+            _mm_storeu_ps(sr + q, _mm_add_ps(var, vbr));
+            _mm_storeu_ps(si + q, _mm_add_ps(vai, vbi));
+            _mm_storeu_ps(sr + q + s, _mm_sub_ps(_mm_mul_ps(tr, vwr), _mm_mul_ps(ti, vwi)));
+            _mm_storeu_ps(si + q + s, _mm_add_ps(_mm_mul_ps(ti, vwr), _mm_mul_ps(tr, vwi)));
+        }
+    }
+}
+
+TARGET_AVX2 static void stockhamAVX2(const float *xr, const float *xi, float *yr, float *yi,
+                                     const float *wr, const float *wi, unsigned m, unsigned s)
+{
+    for (unsigned p = 0; p < m; ++p) {
+        const float *ar = xr + s * p, *ai = xi + s * p;
+        const float *br = ar + s * m, *bi = ai + s * m;
+        float *sr = yr + 2 * s * p, *si = yi + 2 * s * p;
+        const __m256 vwr = _mm256_set1_ps(wr[p]), vwi = _mm256_set1_ps(wi[p]);
+
+        for (unsigned q = 0; q < s; q += 8) {
+            const __m256 var = _mm256_loadu_ps(ar + q), vai = _mm256_loadu_ps(ai + q);
+            const __m256 vbr = _mm256_loadu_ps(br + q), vbi = _mm256_loadu_ps(bi + q);
+            const __m256 tr = _mm256_sub_ps(var, vbr), ti = _mm256_sub_ps(vai, vbi);
+
+            _mm256_storeu_ps(sr + q, _mm256_add_ps(var, vbr));
+            _mm256_storeu_ps(si + q, _mm256_add_ps(vai, vbi));
+            _mm256_storeu_ps(sr + q + s, _mm256_fmsub_ps(tr, vwr, _mm256_mul_ps(ti, vwi)));
+            _mm256_storeu_ps(si + q + s, _mm256_fmadd_ps(ti, vwr, _mm256_mul_ps(tr, vwi)));
+        }
+    }
+}
+
+TARGET_AVX512 static void stockhamAVX512(const float *xr, const float *xi, float *yr, float *yi,
+                                         const float *wr, const float *wi, unsigned m, unsigned s)
+{
+    for (unsigned p = 0; p < m; ++p) {
+        const float *ar = xr + s * p, *ai = xi + s * p;
+        const float *br = ar + s * m, *bi = ai + s * m;
+        float *sr = yr + 2 * s * p, *si = yi + 2 * s * p;
+        const __m512 vwr = _mm512_set1_ps(wr[p]), vwi = _mm512_set1_ps(wi[p]);
+
+        for (unsigned q = 0; q < s; q += 16) {
+            const __m512 var = _mm512_loadu_ps(ar + q), vai = _mm512_loadu_ps(ai + q);
+            const __m512 vbr = _mm512_loadu_ps(br + q), vbi = _mm512_loadu_ps(bi + q);
+            const __m512 tr = _mm512_sub_ps(var, vbr), ti = _mm512_sub_ps(vai, vbi);
+
+            _mm512_storeu_ps(sr + q, _mm512_add_ps(var, vbr));
+            _mm512_storeu_ps(si + q, _mm512_add_ps(vai, vbi));
+            _mm512_storeu_ps(sr + q + s, _mm512_fmsub_ps(tr, vwr, _mm512_mul_ps(ti, vwi)));
+            _mm512_storeu_ps(si + q + s, _mm512_fmadd_ps(ti, vwr, _mm512_mul_ps(tr, vwi)));
+        }
+    }
+}
+
+TARGET_SSE2 static void stockham4SSE2(const float *xr, const float *xi, float *yr, float *yi,
+                                          const float *w, float dir, unsigned m, unsigned s)
+{
+    const __m128 vdir = _mm_set1_ps(dir);
+
+    for (unsigned p = 0; p < m; ++p) {
+        const float *a0r = xr + s * p, *a0i = xi + s * p;
+        float *y0r = yr + 4 * s * p, *y0i = yi + 4 * s * p;
+        const __m128 w1r = _mm_set1_ps(w[p]), w1i = _mm_set1_ps(w[p + m]);
+        const __m128 w2r = _mm_set1_ps(w[p + 2 * m]), w2i = _mm_set1_ps(w[p + 3 * m]);
+        const __m128 w3r = _mm_set1_ps(w[p + 4 * m]), w3i = _mm_set1_ps(w[p + 5 * m]);
+
+        for (unsigned q = 0; q < s; q += 4) {
+            const __m128 x0r = _mm_loadu_ps(a0r + q), x0i = _mm_loadu_ps(a0i + q);
+            const __m128 x1r = _mm_loadu_ps(a0r + q + s * m), x1i = _mm_loadu_ps(a0i + q + s * m);
+            const __m128 x2r = _mm_loadu_ps(a0r + q + 2 * s * m), x2i = _mm_loadu_ps(a0i + q + 2 * s * m);
+            const __m128 x3r = _mm_loadu_ps(a0r + q + 3 * s * m), x3i = _mm_loadu_ps(a0i + q + 3 * s * m);
+
+            const __m128 b0r = _mm_add_ps(x0r, x2r), b0i = _mm_add_ps(x0i, x2i);
+            const __m128 b1r = _mm_sub_ps(x0r, x2r), b1i = _mm_sub_ps(x0i, x2i);
+            const __m128 c0r = _mm_add_ps(x1r, x3r), c0i = _mm_add_ps(x1i, x3i);
+            const __m128 c1r = _mm_mul_ps(vdir, _mm_sub_ps(x3i, x1i));
+            const __m128 c1i = _mm_mul_ps(vdir, _mm_sub_ps(x1r, x3r));
+
+            _mm_storeu_ps(y0r + q, _mm_add_ps(b0r, c0r));
+            _mm_storeu_ps(y0i + q, _mm_add_ps(b0i, c0i));
+
+            __m128 tr = _mm_add_ps(b1r, c1r), ti = _mm_add_ps(b1i, c1i);
+            _mm_storeu_ps(y0r + q + s, _mm_sub_ps(_mm_mul_ps(tr, w1r), _mm_mul_ps(ti, w1i)));
+            _mm_storeu_ps(y0i + q + s, _mm_add_ps(_mm_mul_ps(ti, w1r), _mm_mul_ps(tr, w1i)));
+
+            tr = _mm_sub_ps(b0r, c0r);
+            ti = _mm_sub_ps(b0i, c0i);
+            _mm_storeu_ps(y0r + q + 2 * s, _mm_sub_ps(_mm_mul_ps(tr, w2r), _mm_mul_ps(ti, w2i)));
+            _mm_storeu_ps(y0i + q + 2 * s, _mm_add_ps(_mm_mul_ps(ti, w2r), _mm_mul_ps(tr, w2i)));
+
+            tr = _mm_sub_ps(b1r, c1r);
+            ti = _mm_sub_ps(b1i, c1i);
+            _mm_storeu_ps(y0r + q + 3 * s, _mm_sub_ps(_mm_mul_ps(tr, w3r), _mm_mul_ps(ti, w3i)));
+            _mm_storeu_ps(y0i + q + 3 * s, _mm_add_ps(_mm_mul_ps(ti, w3r), _mm_mul_ps(tr, w3i)));
+        }
+    }
+}
+
+TARGET_AVX2 static void stockham4AVX2(const float *xr, const float *xi, float *yr, float *yi,
+                                          const float *w, float dir, unsigned m, unsigned s)
+{
+    const __m256 vdir = _mm256_set1_ps(dir);
+
+    for (unsigned p = 0; p < m; ++p) {
+        const float *a0r = xr + s * p, *a0i = xi + s * p;
+        float *y0r = yr + 4 * s * p, *y0i = yi + 4 * s * p;
+        const __m256 w1r = _mm256_set1_ps(w[p]), w1i = _mm256_set1_ps(w[p + m]);
+        const __m256 w2r = _mm256_set1_ps(w[p + 2 * m]), w2i = _mm256_set1_ps(w[p + 3 * m]);
+        const __m256 w3r = _mm256_set1_ps(w[p + 4 * m]), w3i = _mm256_set1_ps(w[p + 5 * m]);
+
+        for (unsigned q = 0; q < s; q += 8) {
+            const __m256 x0r = _mm256_loadu_ps(a0r + q), x0i = _mm256_loadu_ps(a0i + q);
+            const __m256 x1r = _mm256_loadu_ps(a0r + q + s * m), x1i = _mm256_loadu_ps(a0i + q + s * m);
+            const __m256 x2r = _mm256_loadu_ps(a0r + q + 2 * s * m), x2i = _mm256_loadu_ps(a0i + q + 2 * s * m);
+            const __m256 x3r = _mm256_loadu_ps(a0r + q + 3 * s * m), x3i = _mm256_loadu_ps(a0i + q + 3 * s * m);
+
+            const __m256 b0r = _mm256_add_ps(x0r, x2r), b0i = _mm256_add_ps(x0i, x2i);
+            const __m256 b1r = _mm256_sub_ps(x0r, x2r), b1i = _mm256_sub_ps(x0i, x2i);
+            const __m256 c0r = _mm256_add_ps(x1r, x3r), c0i = _mm256_add_ps(x1i, x3i);
+            const __m256 c1r = _mm256_mul_ps(vdir, _mm256_sub_ps(x3i, x1i));
+            const __m256 c1i = _mm256_mul_ps(vdir, _mm256_sub_ps(x1r, x3r));
+
+            _mm256_storeu_ps(y0r + q, _mm256_add_ps(b0r, c0r));
+            _mm256_storeu_ps(y0i + q, _mm256_add_ps(b0i, c0i));
+
+            __m256 tr = _mm256_add_ps(b1r, c1r), ti = _mm256_add_ps(b1i, c1i);
+            _mm256_storeu_ps(y0r + q + s, _mm256_sub_ps(_mm256_mul_ps(tr, w1r), _mm256_mul_ps(ti, w1i)));
+            _mm256_storeu_ps(y0i + q + s, _mm256_add_ps(_mm256_mul_ps(ti, w1r), _mm256_mul_ps(tr, w1i)));
+
+            tr = _mm256_sub_ps(b0r, c0r);
+            ti = _mm256_sub_ps(b0i, c0i);
+            _mm256_storeu_ps(y0r + q + 2 * s, _mm256_sub_ps(_mm256_mul_ps(tr, w2r), _mm256_mul_ps(ti, w2i)));
+            _mm256_storeu_ps(y0i + q + 2 * s, _mm256_add_ps(_mm256_mul_ps(ti, w2r), _mm256_mul_ps(tr, w2i)));
+
+            tr = _mm256_sub_ps(b1r, c1r);
+            ti = _mm256_sub_ps(b1i, c1i);
+            _mm256_storeu_ps(y0r + q + 3 * s, _mm256_sub_ps(_mm256_mul_ps(tr, w3r), _mm256_mul_ps(ti, w3i)));
+            _mm256_storeu_ps(y0i + q + 3 * s, _mm256_add_ps(_mm256_mul_ps(ti, w3r), _mm256_mul_ps(tr, w3i)));
+        }
+    }
+}
+
+TARGET_AVX512 static void stockham4AVX512(const float *xr, const float *xi, float *yr, float *yi,
+                                              const float *w, float dir, unsigned m, unsigned s)
+{
+    const __m512 vdir = _mm512_set1_ps(dir);
+
+    for (unsigned p = 0; p < m; ++p) {
+        const float *a0r = xr + s * p, *a0i = xi + s * p;
+        float *y0r = yr + 4 * s * p, *y0i = yi + 4 * s * p;
+        const __m512 w1r = _mm512_set1_ps(w[p]), w1i = _mm512_set1_ps(w[p + m]);
+        const __m512 w2r = _mm512_set1_ps(w[p + 2 * m]), w2i = _mm512_set1_ps(w[p + 3 * m]);
+        const __m512 w3r = _mm512_set1_ps(w[p + 4 * m]), w3i = _mm512_set1_ps(w[p + 5 * m]);
+
+        for (unsigned q = 0; q < s; q += 16) {
+            const __m512 x0r = _mm512_loadu_ps(a0r + q), x0i = _mm512_loadu_ps(a0i + q);
+            const __m512 x1r = _mm512_loadu_ps(a0r + q + s * m), x1i = _mm512_loadu_ps(a0i + q + s * m);
+            const __m512 x2r = _mm512_loadu_ps(a0r + q + 2 * s * m), x2i = _mm512_loadu_ps(a0i + q + 2 * s * m);
+            const __m512 x3r = _mm512_loadu_ps(a0r + q + 3 * s * m), x3i = _mm512_loadu_ps(a0i + q + 3 * s * m);
+
+            const __m512 b0r = _mm512_add_ps(x0r, x2r), b0i = _mm512_add_ps(x0i, x2i);
+            const __m512 b1r = _mm512_sub_ps(x0r, x2r), b1i = _mm512_sub_ps(x0i, x2i);
+            const __m512 c0r = _mm512_add_ps(x1r, x3r), c0i = _mm512_add_ps(x1i, x3i);
+            const __m512 c1r = _mm512_mul_ps(vdir, _mm512_sub_ps(x3i, x1i));
+            const __m512 c1i = _mm512_mul_ps(vdir, _mm512_sub_ps(x1r, x3r));
+
+            _mm512_storeu_ps(y0r + q, _mm512_add_ps(b0r, c0r));
+            _mm512_storeu_ps(y0i + q, _mm512_add_ps(b0i, c0i));
+
+            __m512 tr = _mm512_add_ps(b1r, c1r), ti = _mm512_add_ps(b1i, c1i);
+            _mm512_storeu_ps(y0r + q + s, _mm512_sub_ps(_mm512_mul_ps(tr, w1r), _mm512_mul_ps(ti, w1i)));
+            _mm512_storeu_ps(y0i + q + s, _mm512_add_ps(_mm512_mul_ps(ti, w1r), _mm512_mul_ps(tr, w1i)));
+
+            tr = _mm512_sub_ps(b0r, c0r);
+            ti = _mm512_sub_ps(b0i, c0i);
+            _mm512_storeu_ps(y0r + q + 2 * s, _mm512_sub_ps(_mm512_mul_ps(tr, w2r), _mm512_mul_ps(ti, w2i)));
+            _mm512_storeu_ps(y0i + q + 2 * s, _mm512_add_ps(_mm512_mul_ps(ti, w2r), _mm512_mul_ps(tr, w2i)));
+
+            tr = _mm512_sub_ps(b1r, c1r);
+            ti = _mm512_sub_ps(b1i, c1i);
+            _mm512_storeu_ps(y0r + q + 3 * s, _mm512_sub_ps(_mm512_mul_ps(tr, w3r), _mm512_mul_ps(ti, w3i)));
+            _mm512_storeu_ps(y0i + q + 3 * s, _mm512_add_ps(_mm512_mul_ps(ti, w3r), _mm512_mul_ps(tr, w3i)));
+        }
+    }
+}
+
+#endif // FFTKERNELS_X86
+
+typedef void (*StockhamKernel)(const float *, const float *, float *, float *,
+                               const float *, const float *, unsigned, unsigned);
+
+static StockhamKernel selectStockham(FFTKernels::Isa isa, unsigned s)
+{
+#ifdef FFTKERNELS_X86
+    if (isa >= FFTKernels::AVX512 && s >= 16)
+        return stockhamAVX512;
+    if (isa >= FFTKernels::AVX2 && s >= 8)
+        return stockhamAVX2;
+    if (isa >= FFTKernels::SSE2 && s >= 4)
+        return stockhamSSE2;
+#else
+    Q_UNUSED(isa);
+    Q_UNUSED(s);
+#endif
+    return stockhamScalar;
+}
+
+typedef void (*Stockham4Kernel)(const float *, const float *, float *, float *,
+                                const float *, float, unsigned, unsigned);
+
+static Stockham4Kernel selectStockham4(FFTKernels::Isa isa, unsigned s)
+{
+#ifdef FFTKERNELS_X86
+    if (isa >= FFTKernels::AVX512 && s >= 16)
+        return stockham4AVX512;
+    if (isa >= FFTKernels::AVX2 && s >= 8)
+        return stockham4AVX2;
+    if (isa >= FFTKernels::SSE2 && s >= 4)
+        return stockham4SSE2;
+#else
+    Q_UNUSED(isa);
+    Q_UNUSED(s);
+#endif
+    return stockham4Scalar;
+}
+
+void FFTKernels::stockham(float *real, float *imag, float *workReal, float *workImag,
+                          const FFTPlan &plan)
+{
+    const unsigned n = plan.size();
+    const Isa active = isa();
+    float *xr = real, *xi = imag;
+    float *yr = workReal, *yi = workImag;
+
+    const float dir = plan.isInverse() ? 1.0 : -1.0;
+
+    // Radix-4 stages use the same quarter lengths as radix4Butterflies(), so
+    // their twiddles come from the same tables; odd log sizes end with one
+    // radix-2 stage.
+    const bool odd = plan.log2Size() & 1;
+    unsigned s = 1;
+    for (unsigned m = n / 4; m >= (odd ? 2u : 1u); m /= 4, s *= 4) {
+        Stockham4Kernel stage = selectStockham4(active, s);
+        stage(xr, xi, yr, yi, plan.radix4Twiddles(m), dir, m, s);
+
+        float *tmp = xr; xr = yr; yr = tmp;
+        tmp = xi; xi = yi; yi = tmp;
+    }
+
+    if (odd) {
+        StockhamKernel stage = selectStockham(active, s);
+        stage(xr, xi, yr, yi, plan.twiddleReal(1), plan.twiddleImag(1), 1, s);
+
+        float *tmp = xr; xr = yr; yr = tmp;
+        tmp = xi; xi = yi; yi = tmp;
+    }
+
+    if (xr != real) {
+        memcpy(real, xr, n * sizeof(float));
+        memcpy(imag, xi, n * sizeof(float));
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef FFTKERNELS_H
+#define FFTKERNELS_H
+
+class FFTPlan;
+
+// Radix-2/radix-4 butterflies on split (separate real and imaginary
+// arrays) data, dispatched to the widest instruction set the CPU supports.
+class FFTKernels {
+public:
+    enum Isa {
+        Scalar = 0,
+        SSE2,
+        AVX2,
+        AVX512,
+        ISACOUNT
+    };
+
+    static Isa supportedIsa();
+    static Isa isa();
+    static void setIsa(Isa);
+    static const char *isaName(Isa);
+
+    // Runs every butterfly stage of plan on bit-reversed input
+    static void butterflies(float *real, float *imag, const FFTPlan &plan);
+
+    // Same result as butterflies(), computed with genuine radix-4 stages
+    // (three twiddle multiplications per four points) and one leading
+    // radix-2 stage for odd log sizes
+    static void radix4Butterflies(float *real, float *imag, const FFTPlan &plan);
+
+    // Full transform of natural-order input using Stockham autosort stages,
+    // which ping-pong between the data and work arrays (n entries each) and
+    // leave the result in natural order without a bit-reversal pass
+    static void stockham(float *real, float *imag, float *workReal, float *workImag,
+                         const FFTPlan &plan);
+};
+
+#endif // FFTKERNELS_H
@@ -0,0 +1,119 @@
+#include "fftplan.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+
+typedef QPair<unsigned, bool> FFTPlanKey;
+
+QSharedPointer<const FFTPlan> FFTPlan::plan(unsigned n, bool inverse)
+{
+    static QMutex mutex;
+    static QHash<FFTPlanKey, QSharedPointer<const FFTPlan> > cache;
+
+    if (!IS_POWER_OF_TWO(n))
+        return QSharedPointer<const FFTPlan>();
+
+    QMutexLocker locker(&mutex);
+
+    const FFTPlanKey key(n, inverse);
+    QSharedPointer<const FFTPlan> cached = cache.value(key);
+    if (cached.isNull()) {
+        cached = QSharedPointer<const FFTPlan>(new FFTPlan(n, inverse));
+        cache.insert(key, cached);
+    }
+
+    return cached;
+}
+
+FFTPlan::FFTPlan(unsigned n, bool inverse)
+    : m_size(n)
+    , m_log2Size(log2(n))
+    , m_inverse(inverse)
+    , m_twiddleReal(n > 1 ? n - 1 : 0)
+    , m_twiddleImag(n > 1 ? n - 1 : 0)
+    , m_revbin(n)
+{
+    const double dir = inverse ? 1.0 : -1.0;
+
+    // Stage tables are stored back to back: the stage with half-length mh
+    // starts at offset mh - 1, so every butterfly stage reads contiguously.
+    for (unsigned mh = 1; mh < n; mh <<= 1) {
+        float *wr = m_twiddleReal.data() + mh - 1;
+        float *wi = m_twiddleImag.data() + mh - 1;
+        for (unsigned j = 0; j < mh; ++j) {
+            double angle = dir * M_PI * (double)j / (double)mh;
+            wr[j] = (float)cos(angle);
+            wi[j] = (float)sin(angle);
+        }
+    }
+
+    for (unsigned x = 0; x < n; ++x)
+        m_revbin[x] = revbin(x, m_log2Size);
+
+    // Radix-4 stages start after a single radix-2 stage for odd log sizes
+    m_radix4Offsets = QVector<int>(m_log2Size + 1, -1);
+    for (unsigned quarter = (m_log2Size & 1) ? 2 : 1; 4 * quarter <= n; quarter *= 4) {
+        const unsigned length = 4 * quarter;
+        m_radix4Offsets[(int)log2(quarter)] = m_radix4Twiddles.size();
+
+        QVector<float> stage(6 * quarter);
+        for (unsigned k = 0; k < quarter; ++k) {
+            for (unsigned t = 1; t <= 3; ++t) {
+                double angle = dir * 2.0 * M_PI * (double)(t * k) / (double)length;
+                stage[(2 * t - 2) * quarter + k] = (float)cos(angle);
+                stage[(2 * t - 1) * quarter + k] = (float)sin(angle);
+            }
+        }
+        m_radix4Twiddles += stage;
+    }
+}
+
+unsigned FFTPlan::size() const
+{
+    return m_size;
+}
+
+unsigned FFTPlan::log2Size() const
+{
+    return m_log2Size;
+}
+
+bool FFTPlan::isInverse() const
+{
+    return m_inverse;
+}
+
+const float *FFTPlan::twiddleReal(unsigned mh) const
+{
+    return m_twiddleReal.constData() + mh - 1;
+}
+
+const float *FFTPlan::twiddleImag(unsigned mh) const
+{
+    return m_twiddleImag.constData() + mh - 1;
+}
+
+const unsigned *FFTPlan::revbinTable() const
+{
+    return m_revbin.constData();
+}
+
+const float *FFTPlan::radix4Twiddles(unsigned quarter) const
+{
+    return m_radix4Twiddles.constData() + m_radix4Offsets[(int)log2(quarter)];
+}
+
+unsigned FFTPlan::revbin(unsigned x, unsigned ldn)
+{
+    unsigned r = 0;
+
+    while (ldn-- > 0) {
+        r = r << 1;
+        r = r + (x & 1);
+        x = x >> 1;
+    }
+
+    return r;
+}
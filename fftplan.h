@@ -0,0 +1,45 @@
+#ifndef FFTPLAN_H
+#define FFTPLAN_H
+
+#include <QSharedPointer>
+#include <QVector>
+
+#include "ft.h"
+
+class FFTPlan {
+public:
+    static QSharedPointer<const FFTPlan> plan(unsigned n, bool inverse);
+
+    unsigned size() const;
+    unsigned log2Size() const;
+    bool isInverse() const;
+
+    // Split twiddle factors of the butterfly stage with half-length mh
+    // (mh entries each)
+    const float *twiddleReal(unsigned mh) const;
+    const float *twiddleImag(unsigned mh) const;
+    const unsigned *revbinTable() const;
+
+    // Twiddles W^k, W^2k and W^3k of the radix-4 stage of length 4 * quarter,
+    // stored as six consecutive split arrays of quarter entries
+    // (w1 real, w1 imag, w2 real, w2 imag, w3 real, w3 imag).
+    const float *radix4Twiddles(unsigned quarter) const;
+
+private:
+    FFTPlan(unsigned n, bool inverse);
+    Q_DISABLE_COPY(FFTPlan)
+
+    static unsigned revbin(unsigned, unsigned);
+
+    unsigned m_size;
+    unsigned m_log2Size;
+    bool m_inverse;
+
+    QVector<float> m_twiddleReal;
+    QVector<float> m_twiddleImag;
+    QVector<float> m_radix4Twiddles;
+    QVector<int> m_radix4Offsets;
+    QVector<unsigned> m_revbin;
+};
+
+#endif // FFTPLAN_H
@@ -97,6 +97,7 @@ FImage::FImage()
 
 FImage::FImage(int width, int height)
     : QImage(width, height, QImage::Format_ARGB32_Premultiplied)
+    , m_data(width * height, 0)
     , m_id(QStringLiteral("rect-%1-%2-0-0-0-0").arg(width).arg(height))
 {
     fill(Qt::black);
@@ -129,6 +130,11 @@ QVector<uchar> FImage::data() const
     return m_data;
 }
 
+uchar *FImage::grayBits()
+{
+    return m_data.data();
+}
+
 QString FImage::id() const
 {
     return m_id;
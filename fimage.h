@@ -22,6 +22,10 @@ public:
     FImage(int, int);
     FImage(uchar *, int, int, const QString &id = QString());
     QVector<uchar> data() const;
+
+    // Gray values behind data(), for filling an image in place together
+    // with its scanlines
+    uchar *grayBits();
     QString id() const;
 
 private:
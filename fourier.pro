@@ -22,7 +22,26 @@ SOURCES += main.cpp\
     gpu.cpp \
     clinfo.cpp \
     fftgpu.cpp \
-    rectdialog.cpp
+    rectdialog.cpp \
+    fftplan.cpp \
+    fftkernels.cpp \
+    mixedfftcpu.cpp \
+    mixedfftplan.cpp \
+    parallel.cpp \
+    radix4fftcpu.cpp \
+    stockhamfftcpu.cpp \
+    bufferpool.cpp \
+    spectrumstorage.cpp \
+    fftcodelets.cpp \
+    dftmatrix.cpp \
+    separabledftcpu.cpp \
+    ftbatch.cpp \
+    ftstream.cpp \
+    outofcorefft.cpp \
+    spectrumfile.cpp \
+    convolution.cpp \
+    spectrumfilter.cpp \
+    registration.cpp
 
 HEADERS  += mainwindow.h \
     fimage.h \
@@ -33,7 +52,26 @@ HEADERS  += mainwindow.h \
     gpu.h \
     clinfo.h \
     fftgpu.h \
-    rectdialog.h
+    rectdialog.h \
+    fftplan.h \
+    fftkernels.h \
+    mixedfftcpu.h \
+    mixedfftplan.h \
+    parallel.h \
+    radix4fftcpu.h \
+    stockhamfftcpu.h \
+    bufferpool.h \
+    spectrumstorage.h \
+    fftcodelets.h \
+    dftmatrix.h \
+    separabledftcpu.h \
+    ftbatch.h \
+    ftstream.h \
+    outofcorefft.h \
+    spectrumfile.h \
+    convolution.h \
+    spectrumfilter.h \
+    registration.h
 
 FORMS    += mainwindow.ui \
     rectdialog.ui
@@ -52,6 +90,7 @@ CUDA_PATH = $$(CUDA_PATH)
 
 QMAKE_CXXFLAGS += -std=c++0x
 LIBS += -lOpenCL
+win32: LIBS += -lpsapi
 DEFINES += _USE_MATH_DEFINES CL_USE_DEPRECATED_OPENCL_2_0_APIS CL_USE_DEPRECATED_OPENCL_1_2_APIS
 
 CONFIG(debug, debug|release) {
@@ -1,12 +1,43 @@
 #include "ft.h"
 
+#include <QRect>
 #include <QTime>
 
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FT_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "bufferpool.h"
 #include "dftgpu.h"
 #include "dftcpu.h"
 #include "fftcpu.h"
 #include "fftgpu.h"
 #include "fimage.h"
+#include "mixedfftcpu.h"
+#include "parallel.h"
+#include "radix4fftcpu.h"
+#include "separabledftcpu.h"
+#include "spectrumfile.h"
+#include "spectrumfilter.h"
+#include "stockhamfftcpu.h"
+
+// Spectrum values handed to a thread at a time by calculatePolar()
+static const int kPolarGrain = 16384;
+
+// Image rows handed to a thread at a time by renderSpectrum() and
+// filteredImage()
+static const int kRenderGrain = 16;
+
+// Patch rows, and spectrum rows, handed to a thread at a time by
+// updateSpectrum()
+static const int kUpdateGrain = 4;
+
+// Cost of a transform per element and log2 of its size, relative to one
+// complex multiply-add of the direct update
+static const double kTransformCost = 2.0;
 
 
 Complex::Complex()
@@ -30,6 +61,18 @@ inline float Complex::phase() const
     return qAtan2(imag, real);
 }
 
+ComplexDouble::ComplexDouble()
+    : real(0.0)
+    , imag(0.0)
+{
+}
+
+ComplexDouble::ComplexDouble(double real, double imag)
+    : real(real)
+    , imag(imag)
+{
+}
+
 QDebug operator<<(QDebug debug, const Complex &c)
 {
     QDebug verbose = debug.nospace().noquote();
@@ -49,235 +92,1221 @@ FT *FT::createFT(FTType type, FImage *image)
         return new FFTCpu(image);
     case FTType::FFTGPU:
         return new FFTGpu(image);
+    case FTType::MIXEDFFTCPU:
+        return new MixedFFTCpu<Complex>(image);
+    case FTType::REALFFTCPU:
+        return new FFTCpu(image, FT::HalfSpectrum);
+    case FTType::RADIX4FFTCPU:
+        return new Radix4FFTCpu(image);
+    case FTType::STOCKHAMFFTCPU:
+        return new StockhamFFTCpu(image);
+    case FTType::MIXEDFFTCPUDOUBLE:
+        return new MixedFFTCpu<ComplexDouble>(image);
+    case FTType::SEPARABLEDFTCPU:
+        return new SeparableDFTCpu(image);
     default:
         return 0;
     }
 }
 
+FT *FT::load(FTType type, const QString &path)
+{
+    SpectrumFile *file = new SpectrumFile;
+    if (!file->open(path)) {
+        delete file;
+        return 0;
+    }
+
+    const SpectrumFile::Header &header = file->header();
+    if (header.shifted) {
+        qWarning("%s holds a shifted spectrum", qPrintable(path));
+        delete file;
+        return 0;
+    }
+
+    FImage blank(header.cols, header.rows);
+    FT *ft = createFT(type, &blank);
+    if (!ft) {
+        qWarning("[ERROR] Unknown FT type %d", type);
+        delete file;
+        return 0;
+    }
+
+    ft->attachFile(file);
+
+    return ft;
+}
+
 FT::FT(QObject *parent)
     : QObject(parent)
+    , m_threadCount(1)
+    , m_imageData(0)
+    , m_realData(0)
+    , m_fourier(0)
+    , m_magnitude(0)
+    , m_phase(0)
+    , m_file(0)
+    , m_scratch(0)
+    , m_validOutputs(SpectrumOutput)
+    , m_imageTransformed(false)
+    , m_storageFormat(SpectrumStorage::Float32)
+    , m_packedFourier(0)
 {
 }
 
 FT::FT(FImage *image, QObject *parent)
+    : FT(image, FullSpectrum, parent)
+{
+}
+
+FT::FT(FImage *image, SpectrumLayout layout, QObject *parent)
     : QObject(parent)
     , m_rows(image->height())
     , m_cols(image->width())
+    , m_layout(layout)
+    , m_spectrumCols(layout == HalfSpectrum ? m_cols / 2 + 1 : m_cols)
+    , m_threadCount(Parallel::idealThreadCount())
+    , m_pool(BufferPool::forSize(m_cols, m_rows))
+    , m_imageData(0)
+    , m_realData(0)
     , m_fourier(0)
     , m_magnitude(0)
     , m_phase(0)
+    , m_sourceId(image->id())
+    , m_file(0)
+    , m_scratch(0)
+    , m_validOutputs(SpectrumOutput)
+    , m_imageTransformed(false)
+    , m_storageFormat(SpectrumStorage::Float32)
+    , m_packedFourier(0)
 {
     unsigned size = image->data().size();
     Q_ASSERT(size == m_rows * m_cols);
 
-    m_imageData = new Complex[size];
-    const uchar *values = image->data().constData();
-    for (unsigned i = 0; i < size; ++i)
-        m_imageData[i] = Complex((float)values[i], 0.0);
+    if (m_layout == HalfSpectrum)
+        m_realData = m_pool->acquire<float>(size);
+    else
+        m_imageData = m_pool->acquire<Complex>(size);
+
+    setImageData(image->data().constData());
 }
 
 FT::~FT()
 {
-    if (m_imageData)
-        delete m_imageData;
+    detachFile(false);
+
+    if (!m_pool)
+        return;
+
+    m_pool->release(m_imageData);
+    m_pool->release(m_realData);
 
-    if (m_fourier)
-        delete m_fourier;
-    if (m_magnitude)
-        delete m_magnitude;
-    if (m_phase)
-        delete m_phase;
+    m_pool->release(m_fourier);
+    m_pool->release(m_magnitude);
+    m_pool->release(m_phase);
+    m_pool->release(m_scratch);
+    m_pool->release(m_packedFourier);
 }
 
-int FT::init()
+int FT::init(int outputs)
 {
+    detachFile(false);
+
+    if (!m_fourier)
+        m_fourier = m_pool->acquire<Complex>(spectrumSize());
+
     QTime timer;
     timer.start();
 
-    m_fourier = calculateFourier(m_imageData, false);
+    if (m_layout == HalfSpectrum)
+        calculateRealFourierInto(m_realData, m_fourier);
+    else
+        calculateFourierInto(m_imageData, m_fourier, false);
+
+    m_validOutputs = SpectrumOutput;
+    m_imageTransformed = true;
+    computeOutputs(outputs);
 
     int elapsed = timer.elapsed();
 
-    m_magnitude = calculateMagnitude(m_fourier);
-    m_phase = calculatePhase(m_fourier);
+    packSpectrum();
 
     return elapsed;
 }
 
 int FT::bench()
 {
+    Complex *fourier = m_pool->acquire<Complex>(spectrumSize());
+
     QTime timer;
     timer.start();
 
-    calculateFourier(m_imageData, false);
+    if (m_layout == HalfSpectrum)
+        calculateRealFourierInto(m_realData, fourier);
+    else
+        calculateFourierInto(m_imageData, fourier, false);
 
-    return timer.elapsed();
+    int elapsed = timer.elapsed();
+    m_pool->release(fourier);
+
+    return elapsed;
 }
 
-FImage FT::magnitudeImage() const
+// Gray values of another image of the same size, for the next init()
+void FT::setImageData(const uchar *values)
 {
-    if (!m_magnitude)
-        return FImage(m_cols, m_rows);
+    const unsigned size = m_rows * m_cols;
+    m_imageTransformed = false;
+
+    if (m_layout == HalfSpectrum) {
+        for (unsigned i = 0; i < size; ++i)
+            m_realData[i] = (float)values[i];
+        return;
+    }
+
+    for (unsigned i = 0; i < size; ++i)
+        m_imageData[i] = Complex((float)values[i], 0.0);
+}
+
+int FT::updateImageData(const uchar *values, const QRect &region, int outputs)
+{
+    const QRect changed = region.intersected(QRect(0, 0, m_cols, m_rows));
+
+    if (!m_imageTransformed || m_file || !directUpdateCheaper(changed)) {
+        setImageData(values);
+        return init(outputs);
+    }
 
-    unsigned size = m_cols * m_rows;
-    uchar *data = new uchar[size];
+    QTime timer;
+    timer.start();
 
-    for (unsigned i = 0; i < size; ++i) {
-        float mag = m_magnitude[i];
-        float value = 20 * log(mag + 1);
-        if (value > 255.0)
-            value = 255.0;
-        data[i] = (uchar)value;
+    if (!m_fourier) {
+        m_fourier = m_pool->acquire<Complex>(spectrumSize());
+        SpectrumStorage::unpack(m_storageFormat, m_packedFourier, m_rows, m_spectrumCols, m_fourier);
     }
 
-    return FImage(fftshift<uchar>(data), m_cols, m_rows);
+    if (!changed.isEmpty())
+        updateSpectrum(values, changed);
+
+    m_validOutputs = SpectrumOutput;
+    computeOutputs(outputs);
+
+    int elapsed = timer.elapsed();
+
+    // A compact format rounds the updated spectrum again, so its rounding
+    // errors add up over many updates
+    packSpectrum();
+
+    return elapsed;
 }
 
-float *FT::calculateMagnitude(Complex *input) const
+bool FT::directUpdateCheaper(const QRect &region) const
 {
-    unsigned size = m_rows * m_cols;
-    float *magnitude = new float[size];
+    const double size = (double)m_rows * m_cols;
+    const double direct = (double)region.height() * m_spectrumCols * (region.width() + m_rows);
+    const double transform = kTransformCost * m_rows * m_spectrumCols * log2(size);
 
-    for (unsigned i = 0; i < size; ++i)
-        magnitude[i] = input[i].magnitude();
+    return direct < transform;
+}
 
-    return magnitude;
+// output[u] += twiddle * row[u] for count values
+static inline void addProduct(Complex *output, const Complex *row, const Complex &twiddle, int count)
+{
+    int u = 0;
+
+#ifdef FT_SSE2
+    // Two values at a time, as twiddle.real * (re, im) + twiddle.imag * (-im, re)
+    const __m128 real = _mm_set1_ps(twiddle.real);
+    const __m128 imag = _mm_setr_ps(-twiddle.imag, twiddle.imag, -twiddle.imag, twiddle.imag);
+    for (; u + 2 <= count; u += 2) {
+        const __m128 value = _mm_loadu_ps(&row[u].real);
+        const __m128 swapped = _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1));
+        const __m128 product = _mm_add_ps(_mm_mul_ps(real, value), _mm_mul_ps(imag, swapped));
+        _mm_storeu_ps(&output[u].real, _mm_add_ps(_mm_loadu_ps(&output[u].real), product));
+    }
+#endif
+
+    for (; u < count; ++u) {
+        output[u].real += twiddle.real * row[u].real - twiddle.imag * row[u].imag;
+        output[u].imag += twiddle.real * row[u].imag + twiddle.imag * row[u].real;
+    }
 }
 
-FImage FT::reconstructFromMagnitude()
+// Adds the spectrum of the change inside region, separably: each changed
+// row's spectrum along x, D(y, u), then for every spectrum row v the sum of
+// D(y, u) * e^(-2 pi i v y / rows) over the changed rows. The image data
+// takes the new values on the way.
+void FT::updateSpectrum(const uchar *values, const QRect &region)
 {
-    if (!m_magnitude)
-        return FImage(m_cols, m_rows);
+    const int left = region.x();
+    const int top = region.y();
+    const int width = region.width();
+    const int height = region.height();
+
+    // e^(-2 pi i k / n) for k < n along each axis
+    QVector<Complex> colTwiddles(m_cols);
+    for (int k = 0; k < m_cols; ++k) {
+        const double angle = -2.0 * M_PI * k / m_cols;
+        colTwiddles[k] = Complex(cos(angle), sin(angle));
+    }
+    QVector<Complex> rowTwiddles(m_rows);
+    for (int k = 0; k < m_rows; ++k) {
+        const double angle = -2.0 * M_PI * k / m_rows;
+        rowTwiddles[k] = Complex(cos(angle), sin(angle));
+    }
+
+    // Image-sized, so it holds the row spectra of any region, and unused
+    // here as the spectrum is unpacked into m_fourier
+    Complex *rowSpectra = scratch();
+
+    Parallel::forRange(height, kUpdateGrain, m_threadCount, [&](int begin, int end) {
+        QVector<float> delta(width);
+
+        for (int y = begin; y < end; ++y) {
+            const unsigned offset = (top + y) * m_cols + left;
+            for (int x = 0; x < width; ++x) {
+                const float value = values[offset + x];
+                if (m_layout == HalfSpectrum) {
+                    delta[x] = value - m_realData[offset + x];
+                    m_realData[offset + x] = value;
+                } else {
+                    delta[x] = value - m_imageData[offset + x].real;
+                    m_imageData[offset + x] = Complex(value, 0.0f);
+                }
+            }
+
+            Complex *row = rowSpectra + y * m_spectrumCols;
+            for (int u = 0; u < m_spectrumCols; ++u) {
+                float real = 0.0f;
+                float imag = 0.0f;
+                int k = (int)((qint64)u * left % m_cols);
+                for (int x = 0; x < width; ++x) {
+                    real += delta[x] * colTwiddles[k].real;
+                    imag += delta[x] * colTwiddles[k].imag;
+                    k += u;
+                    if (k >= m_cols)
+                        k -= m_cols;
+                }
+                row[u] = Complex(real, imag);
+            }
+        }
+    });
+
+    Parallel::forRange(m_rows, kUpdateGrain, m_threadCount, [&](int begin, int end) {
+        for (int v = begin; v < end; ++v) {
+            Complex *output = m_fourier + v * m_spectrumCols;
+            int k = (int)((qint64)v * top % m_rows);
+
+            for (int y = 0; y < height; ++y) {
+                addProduct(output, rowSpectra + y * m_spectrumCols, rowTwiddles[k], m_spectrumCols);
+                k += v;
+                if (k >= m_rows)
+                    k -= m_rows;
+            }
+        }
+    });
+}
 
-    unsigned size = m_cols * m_rows;
-    uchar *data = new uchar[size];
+bool FT::save(const QString &path)
+{
+    // The spectrum may be mapped from the very file about to be replaced
+    detachFile(true);
 
-    Complex *magnitude = new Complex[size];
-    for (unsigned i = 0; i < size; ++i)
-        magnitude[i] = Complex(m_magnitude[i], 0.0);
+    const void *fourier = m_fourier ? static_cast<const void *>(m_fourier) : m_packedFourier;
+    if (!fourier) {
+        qWarning("No spectrum to save to %s", qPrintable(path));
+        return false;
+    }
+
+    SpectrumFile::Header header;
+    header.cols = m_cols;
+    header.rows = m_rows;
+    header.layout = m_layout;
+    header.format = m_fourier ? SpectrumStorage::Float32 : m_storageFormat;
+    header.sourceId = m_sourceId;
+
+    return SpectrumFile::write(path, header, fourier, m_validOutputs & MagnitudeOutput ? m_magnitude : 0,
+                               m_validOutputs & PhaseOutput ? m_phase : 0);
+}
+
+QString FT::sourceId() const
+{
+    return m_sourceId;
+}
+
+FT::SpectrumLayout FT::spectrumLayout() const
+{
+    return m_layout;
+}
+
+QString FT::variant() const
+{
+    return QString();
+}
+
+int FT::threadCount() const
+{
+    return m_threadCount;
+}
+
+void FT::setThreadCount(int threads)
+{
+    m_threadCount = qMax(1, threads);
+}
+
+void FT::transform(const Complex *input, Complex *output, bool inverse)
+{
+    calculateFourierInto(input, output, inverse);
+}
 
-    Complex *rec = calculateFourier(magnitude, true);
-    float *recMagnitude = calculateMagnitude(rec);
+void FT::transformInPlace(Complex *data, bool inverse)
+{
+    calculateFourierInto(data, data, inverse);
+}
+
+void FT::transformBatch(const Complex *const *inputs, Complex *const *outputs, int count, bool inverse)
+{
+    calculateFourierBatchInto(inputs, outputs, count, inverse);
+}
 
-    for (unsigned i = 0; i < size; ++i) {
-        float value = recMagnitude[i];
-        if (value > 255.0)
-            value = 255.0;
-        data[i] = (uchar)value;
+void FT::transformReal(const float *input, Complex *spectrum)
+{
+    calculateRealFourierInto(input, spectrum);
+}
+
+void FT::inverseTransformReal(const Complex *spectrum, float *output)
+{
+    calculateRealInverseInto(spectrum, output);
+}
+
+void FT::calculateFourierInto(const Complex *input, Complex *output, bool inverse)
+{
+    Complex *fourier = calculateFourier(const_cast<Complex *>(input), inverse);
+    memcpy(output, fourier, m_rows * m_cols * sizeof(Complex));
+    delete[] fourier;
+}
+
+// Engines that can share passes or launches across a batch override this
+void FT::calculateFourierBatchInto(const Complex *const *inputs, Complex *const *outputs,
+                                   int count, bool inverse)
+{
+    for (int i = 0; i < count; ++i)
+        calculateFourierInto(inputs[i], outputs[i], inverse);
+}
+
+SpectrumStorage::Format FT::storageFormat() const
+{
+    return m_storageFormat;
+}
+
+void FT::setStorageFormat(SpectrumStorage::Format format)
+{
+    if (format == m_storageFormat)
+        return;
+
+    detachFile(true);
+
+    // Keep an existing spectrum, converted to the new format
+    if (!m_fourier && m_packedFourier) {
+        m_fourier = m_pool->acquire<Complex>(spectrumSize());
+        SpectrumStorage::unpack(m_storageFormat, m_packedFourier, m_rows, m_spectrumCols, m_fourier);
     }
+    m_pool->release(m_packedFourier);
+    m_packedFourier = 0;
+
+    m_storageFormat = format;
+    packSpectrum();
+}
 
-    delete magnitude;
-    delete rec;
-    delete recMagnitude;
+// Replaces the float spectrum by its compact form, if one is selected
+void FT::packSpectrum()
+{
+    if (!m_fourier || m_storageFormat == SpectrumStorage::Float32)
+        return;
+
+    if (!m_packedFourier)
+        m_packedFourier = m_pool->acquire(SpectrumStorage::bytes(m_storageFormat, m_rows, m_spectrumCols));
+    SpectrumStorage::pack(m_storageFormat, m_fourier, m_rows, m_spectrumCols, m_packedFourier);
 
-    return FImage(data, m_cols, m_rows);
+    m_pool->release(m_fourier);
+    m_fourier = 0;
 }
 
+// The spectrum computed by init(), unpacked into scratch() if stored compact
+const Complex *FT::spectrum()
+{
+    if (m_fourier || !m_packedFourier)
+        return m_fourier;
 
-FImage FT::phaseImage() const
+    Complex *fourier = scratch();
+    SpectrumStorage::unpack(m_storageFormat, m_packedFourier, m_rows, m_spectrumCols, fourier);
+
+    return fourier;
+}
+
+// Points the spectrum, and the outputs the file holds, into its mapping
+// when the layouts match. A spectrum of the other layout is converted into
+// a float spectrum of this one, and its outputs are left to be recomputed.
+void FT::attachFile(SpectrumFile *file)
+{
+    const SpectrumFile::Header &header = file->header();
+    m_sourceId = header.sourceId;
+
+    if (header.layout == m_layout) {
+        m_file = file;
+        m_storageFormat = header.format;
+        if (m_storageFormat == SpectrumStorage::Float32)
+            m_fourier = static_cast<Complex *>(file->spectrum());
+        else
+            m_packedFourier = file->spectrum();
+
+        m_magnitude = file->magnitude();
+        m_phase = file->phase();
+        m_validOutputs = (m_magnitude ? MagnitudeOutput : 0) | (m_phase ? PhaseOutput : 0);
+        return;
+    }
+
+    const int fileCols = file->spectrumCols();
+    Complex *values = m_pool->acquire<Complex>(m_rows * fileCols);
+    SpectrumStorage::unpack(header.format, file->spectrum(), m_rows, fileCols, values);
+
+    m_fourier = m_pool->acquire<Complex>(spectrumSize());
+    for (int r = 0; r < m_rows; ++r) {
+        const int mirrorRow = r ? m_rows - r : 0;
+        for (int c = 0; c < m_spectrumCols; ++c) {
+            if (c < fileCols) {
+                m_fourier[c + r * m_spectrumCols] = values[c + r * fileCols];
+            } else {
+                const Complex &value = values[m_cols - c + mirrorRow * fileCols];
+                m_fourier[c + r * m_spectrumCols] = Complex(value.real, -value.imag);
+            }
+        }
+    }
+
+    m_pool->release(values);
+    delete file;
+}
+
+template <typename T>
+static void detachBuffer(BufferPool *pool, T *&buffer, const void *mapped, size_t bytes, bool keepValues)
 {
+    if (!buffer || buffer != mapped)
+        return;
+
+    buffer = 0;
+    if (keepValues) {
+        buffer = static_cast<T *>(pool->acquire(bytes));
+        memcpy(buffer, mapped, bytes);
+    }
+}
+
+// Closes the file from load(), first copying the values still used from
+// its mapping into pool buffers if keepValues is set
+void FT::detachFile(bool keepValues)
+{
+    if (!m_file)
+        return;
+
+    const unsigned size = spectrumSize();
+    BufferPool *pool = m_pool.data();
+    const size_t spectrumBytes = SpectrumStorage::bytes(m_storageFormat, m_rows, m_spectrumCols);
+
+    detachBuffer(pool, m_fourier, m_file->spectrum(), spectrumBytes, keepValues);
+    detachBuffer(pool, m_packedFourier, m_file->spectrum(), spectrumBytes, keepValues);
+    detachBuffer(pool, m_magnitude, m_file->magnitude(), size * sizeof(float), keepValues);
+    detachBuffer(pool, m_phase, m_file->phase(), size * sizeof(float), keepValues);
+
+    if (!m_magnitude)
+        m_validOutputs &= ~MagnitudeOutput;
     if (!m_phase)
-        return FImage(m_cols, m_rows);
+        m_validOutputs &= ~PhaseOutput;
+
+    delete m_file;
+    m_file = 0;
+}
+
+QVector<double> FT::spectrumErrors(const ComplexDouble *reference)
+{
+    Complex *fourier = m_pool->acquire<Complex>(spectrumSize());
+    Complex *values = m_pool->acquire<Complex>(spectrumSize());
+
+    if (m_layout == HalfSpectrum)
+        calculateRealFourierInto(m_realData, fourier);
+    else
+        calculateFourierInto(m_imageData, fourier, false);
+
+    QVector<double> errors(SpectrumStorage::FORMATCOUNT);
+    for (int f = 0; f < SpectrumStorage::FORMATCOUNT; ++f) {
+        const SpectrumStorage::Format format = (SpectrumStorage::Format)f;
+        const Complex *roundTrip = fourier;
+        if (format != SpectrumStorage::Float32) {
+            void *packed = m_pool->acquire(SpectrumStorage::bytes(format, m_rows, m_spectrumCols));
+            SpectrumStorage::pack(format, fourier, m_rows, m_spectrumCols, packed);
+            SpectrumStorage::unpack(format, packed, m_rows, m_spectrumCols, values);
+            m_pool->release(packed);
+            roundTrip = values;
+        }
 
-    int size = m_cols * m_rows;
-    uchar *data = new uchar[size];
+        double error = 0.0;
+        double norm = 0.0;
+        for (int r = 0; r < m_rows; ++r) {
+            for (int c = 0; c < m_spectrumCols; ++c) {
+                const ComplexDouble &expected = reference[c + r * m_cols];
+                const Complex &value = roundTrip[c + r * m_spectrumCols];
+                const double real = value.real - expected.real;
+                const double imag = value.imag - expected.imag;
+
+                error += real * real + imag * imag;
+                norm += expected.real * expected.real + expected.imag * expected.imag;
+            }
+        }
 
-    for (int i = 0; i < size; ++i) {
-        float value = m_phase[i] + (float)M_PI;
-        value *= 255.0/(2.0 * (float)M_PI);
-        data[i] = (uchar)value;
+        errors[f] = norm > 0.0 ? sqrt(error / norm) : sqrt(error);
     }
 
-    return FImage(fftshift<uchar>(data), m_cols, m_rows);
+    m_pool->release(fourier);
+    m_pool->release(values);
+
+    return errors;
 }
 
-float *FT::calculatePhase(Complex *input) const
+const float *FT::magnitude()
 {
-    unsigned size = m_rows * m_cols;
-    float *phase = new float[size];
+    computeOutputs(MagnitudeOutput);
+    return m_validOutputs & MagnitudeOutput ? m_magnitude : 0;
+}
+
+const float *FT::phase()
+{
+    computeOutputs(PhaseOutput);
+    return m_validOutputs & PhaseOutput ? m_phase : 0;
+}
+
+// Computes the requested outputs that are not up to date yet, in one pass
+// over the spectrum. Arrays are only acquired once they are needed.
+void FT::computeOutputs(int outputs)
+{
+    const int missing = outputs & ~m_validOutputs;
+    if (!missing)
+        return;
+
+    const Complex *fourier = spectrum();
+    if (!fourier)
+        return;
+
+    if ((missing & MagnitudeOutput) && !m_magnitude)
+        m_magnitude = m_pool->acquire<float>(spectrumSize());
+    if ((missing & PhaseOutput) && !m_phase)
+        m_phase = m_pool->acquire<float>(spectrumSize());
+
+    calculatePolar(fourier, missing & MagnitudeOutput ? m_magnitude : 0,
+                   missing & PhaseOutput ? m_phase : 0, spectrumSize());
+    m_validOutputs |= missing;
+}
+
+// Image-sized buffer the spectrum is unpacked into
+Complex *FT::scratch()
+{
+    if (!m_scratch)
+        m_scratch = m_pool->acquire<Complex>(m_rows * m_cols);
+
+    return m_scratch;
+}
 
+unsigned FT::spectrumSize() const
+{
+    return m_rows * m_spectrumCols;
+}
+
+void FT::calculateRealFourierInto(const float *input, Complex *output)
+{
+    unsigned size = m_rows * m_cols;
+    Complex *data = m_layout == FullSpectrum ? output : m_pool->acquire<Complex>(size);
     for (unsigned i = 0; i < size; ++i)
-        phase[i] = input[i].phase();
+        data[i] = Complex(input[i], 0.0);
 
-    return phase;
+    transformInPlace(data);
+
+    if (m_layout == FullSpectrum)
+        return;
+
+    for (int r = 0; r < m_rows; ++r)
+        memcpy(output + r * m_spectrumCols, data + r * m_cols, m_spectrumCols * sizeof(Complex));
+    m_pool->release(data);
 }
 
-FImage FT::reconstructFromPhase()
+void FT::calculateRealInverseInto(const Complex *spectrum, float *output)
 {
-    if (!m_phase)
-        return FImage(m_cols, m_rows);
+    unsigned size = m_rows * m_cols;
+    Complex *rec = m_pool->acquire<Complex>(size);
+    if (m_layout == HalfSpectrum)
+        expandHalfSpectrum(spectrum, rec);
+    else
+        memcpy(rec, spectrum, size * sizeof(Complex));
 
-    unsigned size = m_cols * m_rows;
-    uchar *data = new uchar[size];
+    transformInPlace(rec, true);
 
-    Complex *phase = new Complex[size];
     for (unsigned i = 0; i < size; ++i)
-        phase[i] = Complex(m_phase[i], 0.0);
+        output[i] = rec[i].real;
 
-    Complex *rec = calculateFourier(phase, true);
-    float *recPhase = calculatePhase(rec);
+    m_pool->release(rec);
+}
 
-    for (unsigned i = 0; i < size; ++i) {
-        float value = recPhase[i] + (float)M_PI;
-        value *= 255.0/(2.0 * (float)M_PI);
-        data[i] = (uchar)value;
+void FT::expandHalfSpectrum(const float *input, float *output, float mirrorSign) const
+{
+    for (int r = 0; r < m_rows; ++r) {
+        const int mirrorRow = r ? m_rows - r : 0;
+        for (int c = 0; c < m_cols; ++c) {
+            if (c < m_spectrumCols)
+                output[c + r * m_cols] = input[c + r * m_spectrumCols];
+            else
+                output[c + r * m_cols] = mirrorSign * input[m_cols - c + mirrorRow * m_spectrumCols];
+        }
     }
+}
 
-    delete phase;
-    delete rec;
-    delete recPhase;
+void FT::expandHalfSpectrum(const Complex *input, Complex *output) const
+{
+    for (int r = 0; r < m_rows; ++r) {
+        const int mirrorRow = r ? m_rows - r : 0;
+        for (int c = 0; c < m_cols; ++c) {
+            if (c < m_spectrumCols) {
+                output[c + r * m_cols] = input[c + r * m_spectrumCols];
+            } else {
+                const Complex &value = input[m_cols - c + mirrorRow * m_spectrumCols];
+                output[c + r * m_cols] = Complex(value.real, -value.imag);
+            }
+        }
+    }
+}
+
+// Maps a squared magnitude m2 to (uchar)min(20 * log(sqrt(m2) + 1), 255)
+// without a log or sqrt: m_threshold[k] is the smallest m2 of gray value k.
+// m_bucket, indexed by the exponent and top four mantissa bits of m2, holds
+// the gray value at the low end of each bucket. A bucket spans less than one
+// gray level, so one threshold comparison finishes the lookup exactly.
+class MagnitudeScale {
+public:
+    MagnitudeScale()
+    {
+        for (int k = 0; k < 256; ++k) {
+            const double magnitude = exp(k / 20.0) - 1.0;
+            m_threshold[k] = magnitude * magnitude;
+        }
+        m_threshold[256] = std::numeric_limits<float>::infinity();
+
+        for (quint32 b = 0; b < kBuckets; ++b) {
+            const quint32 bits = b << kBucketShift;
+            float low;
+            memcpy(&low, &bits, sizeof(low));
+
+            int k = 0;
+            while (k < 255 && !(low < m_threshold[k + 1]))
+                ++k;
+            m_bucket[b] = k;
+        }
+    }
+
+    inline uchar gray(float m2) const
+    {
+        quint32 bits;
+        memcpy(&bits, &m2, sizeof(bits));
+
+        // Infinity reaches m_threshold[256] and would wrap to 0
+        const int k = m_bucket[(bits >> kBucketShift) & (kBuckets - 1)];
+        return qMin(k + (m2 >= m_threshold[k + 1]), 255);
+    }
 
-    return FImage(data, m_cols, m_rows);
+private:
+    static const int kBucketShift = 19;
+    static const quint32 kBuckets = 1 << 12;
+
+    float m_threshold[257];
+    uchar m_bucket[kBuckets];
+};
+
+static const MagnitudeScale &magnitudeScale()
+{
+    static const MagnitudeScale scale;
+    return scale;
 }
 
-FImage FT::reconstructOriginalImage()
+static const float kPhaseScale = 255.0 / (2.0 * M_PI);
+
+// atan2 to about 1e-5 rad, far below the 2 pi / 255 of a phase gray level.
+// Spectrum signs are random, so the quadrant is fixed up with selects.
+static inline float phaseAngle(float y, float x)
 {
-    if (!m_fourier)
+    const float ax = qAbs(x);
+    const float ay = qAbs(y);
+    const float high = qMax(ax, ay);
+    const float t = high > 0.0f ? qMin(ax, ay) / high : 0.0f;
+    const float t2 = t * t;
+
+    float angle = t * (0.99986601f + t2 * (-0.33029950f + t2 * (0.18014100f
+                + t2 * (-0.08513300f + t2 * 0.02083510f))));
+    angle = ay > ax ? (float)M_PI_2 - angle : angle;
+    angle = x < 0.0f ? (float)M_PI - angle : angle;
+    return copysignf(angle, y);
+}
+
+struct MagnitudePixel {
+    const MagnitudeScale *scale;
+
+    inline uchar operator()(const Complex &value, bool) const
+    {
+        return scale->gray(value.real * value.real + value.imag * value.imag);
+    }
+};
+
+struct PhasePixel {
+    inline uchar operator()(const Complex &value, bool mirrored) const
+    {
+        const float phase = phaseAngle(mirrored ? -value.imag : value.imag, value.real);
+        return (uchar)((phase + (float)M_PI) * kPhaseScale);
+    }
+};
+
+// One run of pixels from count spectrum values, step (1 or -1) apart
+template <typename Pixel>
+static void renderPixels(const Complex *source, int step, int count, Pixel pixel, bool mirrored,
+                         uchar *gray, QRgb *line)
+{
+    for (int k = 0; k < count; ++k) {
+        const uchar value = pixel(source[k * step], mirrored);
+        gray[k] = value;
+        line[k] = 0xff000000u | value * 0x010101u;
+    }
+}
+
+template <typename Pixel>
+static void renderRun(const Complex *source, int step, int count, Pixel pixel, bool mirrored,
+                      uchar *gray, QRgb *line)
+{
+    renderPixels(source, step, count, pixel, mirrored, gray, line);
+}
+
+#ifdef FT_SSE2
+
+// PhasePixel four values at a time; the scalar loop finishes the run
+template <>
+void renderRun<PhasePixel>(const Complex *source, int step, int count, PhasePixel pixel,
+                           bool mirrored, uchar *gray, QRgb *line)
+{
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 conjugate = mirrored ? sign : _mm_setzero_ps();
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 halfPi = _mm_set1_ps((float)M_PI_2);
+    const __m128 pi = _mm_set1_ps((float)M_PI);
+    const __m128 scale = _mm_set1_ps(kPhaseScale);
+    const __m128i alpha = _mm_set1_epi32(0xff000000);
+
+    int k = 0;
+    for (; k + 4 <= count; k += 4) {
+        // Four consecutive values in memory, lowest address first
+        const float *values = &source[step > 0 ? k : -k - 3].real;
+        const __m128 a = _mm_loadu_ps(values);
+        const __m128 b = _mm_loadu_ps(values + 4);
+        __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        if (step < 0) {
+            re = _mm_shuffle_ps(re, re, _MM_SHUFFLE(0, 1, 2, 3));
+            im = _mm_shuffle_ps(im, im, _MM_SHUFFLE(0, 1, 2, 3));
+        }
+        im = _mm_xor_ps(im, conjugate);
+
+        const __m128 ax = _mm_andnot_ps(sign, re);
+        const __m128 ay = _mm_andnot_ps(sign, im);
+        const __m128 high = _mm_max_ps(ax, ay);
+        const __m128 t = _mm_and_ps(_mm_div_ps(_mm_min_ps(ax, ay), high), _mm_cmpgt_ps(high, zero));
+        const __m128 t2 = _mm_mul_ps(t, t);
+
+        __m128 angle = _mm_add_ps(_mm_set1_ps(-0.08513300f), _mm_mul_ps(t2, _mm_set1_ps(0.02083510f)));
+        angle = _mm_add_ps(_mm_set1_ps(0.18014100f), _mm_mul_ps(t2, angle));
+        angle = _mm_add_ps(_mm_set1_ps(-0.33029950f), _mm_mul_ps(t2, angle));
+        angle = _mm_add_ps(_mm_set1_ps(0.99986601f), _mm_mul_ps(t2, angle));
+        angle = _mm_mul_ps(t, angle);
+
+        const __m128 swapped = _mm_cmpgt_ps(ay, ax);
+        angle = _mm_or_ps(_mm_and_ps(swapped, _mm_sub_ps(halfPi, angle)), _mm_andnot_ps(swapped, angle));
+        const __m128 left = _mm_cmplt_ps(re, zero);
+        angle = _mm_or_ps(_mm_and_ps(left, _mm_sub_ps(pi, angle)), _mm_andnot_ps(left, angle));
+        angle = _mm_or_ps(angle, _mm_and_ps(sign, im));
+
+        const __m128i value = _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(angle, pi), scale));
+        const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(value, value), value);
+        const int packed = _mm_cvtsi128_si32(bytes);
+        memcpy(gray + k, &packed, sizeof(packed));
+
+        const __m128i rgb = _mm_or_si128(_mm_or_si128(value, _mm_slli_epi32(value, 8)), _mm_slli_epi32(value, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(line + k), _mm_or_si128(rgb, alpha));
+    }
+
+    renderPixels(source + k * step, step, count - k, pixel, mirrored, gray + k, line + k);
+}
+
+#endif
+
+// Writes the fftshifted image of pixel(value, mirrored) over the spectrum
+// straight into the gray values and scanlines of image, in one pass. Each
+// output row is two runs of stored spectrum columns; in a half spectrum
+// the columns past m_spectrumCols are read backwards from the mirrored row
+// and passed as mirrored, i.e. to be conjugated.
+template <typename Pixel>
+void FT::renderSpectrum(FImage &image, const Complex *fourier, const Pixel &pixel) const
+{
+    uchar *gray = image.grayBits();
+    uchar *bits = image.bits();
+    const int bytesPerLine = image.bytesPerLine();
+
+    // Output row y shows spectrum row y + rowSplit, and likewise for columns
+    const int rowSplit = m_rows - m_rows / 2;
+    const int colSplit = m_cols - m_cols / 2;
+
+    auto run = [&](int r, int x0, int x1, uchar *grayLine, QRgb *line) {
+        const int direct = qMax(0, qMin(x1, m_spectrumCols) - x0);
+        renderRun(fourier + r * m_spectrumCols + x0, 1, direct, pixel, false, grayLine, line);
+
+        const int mirrorBegin = qMax(x0, m_spectrumCols);
+        if (mirrorBegin >= x1)
+            return;
+
+        const int mirrorRow = r ? m_rows - r : 0;
+        const Complex *mirror = fourier + mirrorRow * m_spectrumCols + (m_cols - mirrorBegin);
+        const int offset = mirrorBegin - x0;
+        renderRun(mirror, -1, x1 - mirrorBegin, pixel, true, grayLine + offset, line + offset);
+    };
+
+    Parallel::forRange(m_rows, kRenderGrain, m_threadCount, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            int r = y + rowSplit;
+            if (r >= m_rows)
+                r -= m_rows;
+
+            uchar *grayLine = gray + y * m_cols;
+            QRgb *line = reinterpret_cast<QRgb *>(bits + y * bytesPerLine);
+            run(r, colSplit, m_cols, grayLine, line);
+            run(r, 0, colSplit, grayLine + m_cols - colSplit, line + m_cols - colSplit);
+        }
+    });
+}
+
+FImage FT::magnitudeImage()
+{
+    const Complex *fourier = spectrum();
+    if (!fourier)
+        return FImage(m_cols, m_rows);
+
+    const MagnitudePixel pixel = { &magnitudeScale() };
+    FImage image(m_cols, m_rows);
+    renderSpectrum(image, fourier, pixel);
+
+    return image;
+}
+
+float *FT::calculateMagnitude(const Complex *input, unsigned size) const
+{
+    float *magnitude = new float[size];
+    calculateMagnitude(input, magnitude, size);
+
+    return magnitude;
+}
+
+void FT::calculateMagnitude(const Complex *input, float *magnitude, unsigned size) const
+{
+    calculatePolar(input, magnitude, 0, size);
+}
+
+FImage FT::reconstructFromMagnitude()
+{
+    FImage image;
+    reconstruct(&image, 0, 0);
+
+    return image;
+}
+
+FImage FT::phaseImage()
+{
+    const Complex *fourier = spectrum();
+    if (!fourier)
         return FImage(m_cols, m_rows);
 
-    unsigned size = m_cols * m_rows;
-    uchar *data = new uchar[size];
+    FImage image(m_cols, m_rows);
+    renderSpectrum(image, fourier, PhasePixel());
+
+    return image;
+}
+
+float *FT::calculatePhase(const Complex *input, unsigned size) const
+{
+    float *phase = new float[size];
+    calculatePhase(input, phase, size);
+
+    return phase;
+}
+
+void FT::calculatePhase(const Complex *input, float *phase, unsigned size) const
+{
+    calculatePolar(input, 0, phase, size);
+}
 
-    Complex *rec = calculateFourier(m_fourier, true);
+// Either output may be 0; with both, each value is read only once
+void FT::calculatePolar(const Complex *input, float *magnitude, float *phase, unsigned size) const
+{
+    Parallel::forRange(size, kPolarGrain, m_threadCount, [&](int begin, int end) {
+        if (magnitude && phase) {
+            for (int i = begin; i < end; ++i) {
+                const Complex value = input[i];
+                magnitude[i] = value.magnitude();
+                phase[i] = value.phase();
+            }
+        } else if (magnitude) {
+            for (int i = begin; i < end; ++i)
+                magnitude[i] = input[i].magnitude();
+        } else if (phase) {
+            for (int i = begin; i < end; ++i)
+                phase[i] = input[i].phase();
+        }
+    });
+}
 
+FImage FT::reconstructFromPhase()
+{
+    FImage image;
+    reconstruct(0, &image, 0);
+
+    return image;
+}
+
+FImage FT::reconstructOriginalImage()
+{
+    FImage image;
+    reconstruct(0, 0, &image);
+
+    return image;
+}
+
+template <typename Quantize>
+static FImage quantizedImage(BufferPool *pool, int cols, int rows, Quantize quantize)
+{
+    const unsigned size = cols * rows;
+    uchar *data = pool->acquire<uchar>(size);
     for (unsigned i = 0; i < size; ++i)
-        data[i] = (uchar)rec[i].real;
+        data[i] = quantize(i);
 
-    delete rec;
+    FImage image(data, cols, rows);
+    pool->release(data);
 
-    return FImage(data, m_cols, m_rows);
+    return image;
 }
 
-template <typename T>
-T *FT::fftshift(const T *input, bool inverse) const
+static inline uchar clampGray(float value)
 {
-    unsigned size = m_rows * m_cols;
-    T *output = new T[size];
+    return (uchar)qMin(value, 255.0f);
+}
 
-    int rowsMid = m_rows / 2;
-    int oddRows = m_rows & 1;
+// The inverse transforms of all requested reconstructions run as one batch.
+// With a half spectrum, the magnitude and the spectrum itself both have
+// real inverses: requested together, they are inverted as the one complex
+// spectrum M + iF, whose real and imaginary parts are the two results.
+void FT::reconstruct(FImage *fromMagnitude, FImage *fromPhase, FImage *original)
+{
+    computeOutputs((fromMagnitude ? MagnitudeOutput : 0) | (fromPhase ? PhaseOutput : 0));
+    const float *spectrumMagnitude = fromMagnitude ? magnitude() : 0;
+    const float *spectrumPhase = fromPhase ? phase() : 0;
+    const Complex *fourier = original ? spectrum() : 0;
+
+    if (fromMagnitude && !spectrumMagnitude)
+        *fromMagnitude = FImage(m_cols, m_rows);
+    if (fromPhase && !spectrumPhase)
+        *fromPhase = FImage(m_cols, m_rows);
+    if (original && !fourier)
+        *original = FImage(m_cols, m_rows);
+
+    const unsigned size = m_cols * m_rows;
+    const bool half = m_layout == HalfSpectrum;
+
+    const Complex *inputs[3];
+    Complex *outputs[3];
+    int count = 0;
+
+    // The phase is odd, so its inverse is not real: it is expanded and run
+    // through the complex transform even for a half spectrum.
+    Complex *phaseRec = 0;
+    if (spectrumPhase) {
+        phaseRec = m_pool->acquire<Complex>(size);
+
+        float *expanded = 0;
+        if (half) {
+            expanded = m_pool->acquire<float>(size);
+            expandHalfSpectrum(spectrumPhase, expanded, -1.0);
+        }
+        const float *fullPhase = expanded ? expanded : spectrumPhase;
 
-    int colsMid = m_cols / 2;
-    int oddCols = m_cols & 1;
+        for (unsigned i = 0; i < size; ++i)
+            phaseRec[i] = Complex(fullPhase[i], 0.0);
+        m_pool->release(expanded);
 
-    for (int i = 0; i < m_rows; ++i) {
-        T vector[m_cols];
-        for (int j = 0; j < m_cols; ++j) {
-            int index = j + i * m_cols;
+        inputs[count] = outputs[count] = phaseRec;
+        ++count;
+    }
 
-            int colIndex = j + colsMid + (oddCols & inverse);
-            if (colIndex >= m_cols)
-                colIndex = colIndex - m_cols;
+    Complex *magnitudeRec = 0;
+    Complex *originalRec = 0;
+    float *realMagnitudeRec = 0;
+    float *realOriginalRec = 0;
+
+    if (half && spectrumMagnitude && fourier) {
+        Complex *pair = m_pool->acquire<Complex>(size);
+        for (int r = 0; r < m_rows; ++r) {
+            const int mirrorRow = r ? m_rows - r : 0;
+            for (int c = 0; c < m_cols; ++c) {
+                float m;
+                Complex f;
+                if (c < m_spectrumCols) {
+                    m = spectrumMagnitude[c + r * m_spectrumCols];
+                    f = fourier[c + r * m_spectrumCols];
+                } else {
+                    m = spectrumMagnitude[m_cols - c + mirrorRow * m_spectrumCols];
+                    f = fourier[m_cols - c + mirrorRow * m_spectrumCols];
+                    f.imag = -f.imag;
+                }
+                pair[c + r * m_cols] = Complex(m - f.imag, f.real);
+            }
+        }
 
-            vector[colIndex] = input[index];
+        magnitudeRec = originalRec = pair;
+        inputs[count] = outputs[count] = pair;
+        ++count;
+    } else if (half) {
+        // A single real inverse keeps the faster real transform
+        if (spectrumMagnitude) {
+            Complex *halfMagnitude = m_pool->acquire<Complex>(spectrumSize());
+            for (unsigned i = 0; i < spectrumSize(); ++i)
+                halfMagnitude[i] = Complex(spectrumMagnitude[i], 0.0);
+
+            realMagnitudeRec = m_pool->acquire<float>(size);
+            calculateRealInverseInto(halfMagnitude, realMagnitudeRec);
+            m_pool->release(halfMagnitude);
+        }
+        if (fourier) {
+            realOriginalRec = m_pool->acquire<float>(size);
+            calculateRealInverseInto(fourier, realOriginalRec);
+        }
+    } else {
+        if (spectrumMagnitude) {
+            magnitudeRec = m_pool->acquire<Complex>(size);
+            for (unsigned i = 0; i < size; ++i)
+                magnitudeRec[i] = Complex(spectrumMagnitude[i], 0.0);
+
+            inputs[count] = outputs[count] = magnitudeRec;
+            ++count;
         }
+        if (fourier) {
+            originalRec = m_pool->acquire<Complex>(size);
+            inputs[count] = fourier;
+            outputs[count] = originalRec;
+            ++count;
+        }
+    }
 
-        int rowIndex = i + rowsMid + (oddRows & inverse);
-        if (rowIndex >= m_rows)
-            rowIndex = rowIndex - m_rows;
+    if (count)
+        calculateFourierBatchInto(inputs, outputs, count, true);
+
+    if (realMagnitudeRec) {
+        *fromMagnitude = quantizedImage(m_pool.data(), m_cols, m_rows, [&](unsigned i) {
+            return clampGray(qAbs(realMagnitudeRec[i]));
+        });
+    } else if (magnitudeRec && half) {
+        *fromMagnitude = quantizedImage(m_pool.data(), m_cols, m_rows, [&](unsigned i) {
+            return clampGray(qAbs(magnitudeRec[i].real));
+        });
+    } else if (magnitudeRec) {
+        *fromMagnitude = quantizedImage(m_pool.data(), m_cols, m_rows, [&](unsigned i) {
+            return clampGray(magnitudeRec[i].magnitude());
+        });
+    }
+
+    if (phaseRec) {
+        *fromPhase = quantizedImage(m_pool.data(), m_cols, m_rows, [&](unsigned i) {
+            return (uchar)((phaseRec[i].phase() + (float)M_PI) * kPhaseScale);
+        });
+    }
 
-        memcpy(output + rowIndex * m_cols, &vector, m_cols * sizeof(T));
+    if (realOriginalRec) {
+        *original = quantizedImage(m_pool.data(), m_cols, m_rows, [&](unsigned i) {
+            return (uchar)realOriginalRec[i];
+        });
+    } else if (originalRec && half) {
+        *original = quantizedImage(m_pool.data(), m_cols, m_rows, [&](unsigned i) {
+            return (uchar)originalRec[i].imag;
+        });
+    } else if (originalRec) {
+        *original = quantizedImage(m_pool.data(), m_cols, m_rows, [&](unsigned i) {
+            return (uchar)originalRec[i].real;
+        });
     }
 
-    return output;
+    m_pool->release(phaseRec);
+    m_pool->release(magnitudeRec);
+    if (originalRec != magnitudeRec)
+        m_pool->release(originalRec);
+    m_pool->release(realMagnitudeRec);
+    m_pool->release(realOriginalRec);
+}
+
+FImage FT::filteredImage(const QVector<SpectrumFilter> &filters)
+{
+    const Complex *fourier = spectrum();
+    if (!fourier)
+        return FImage(m_cols, m_rows);
+
+    const unsigned size = m_rows * m_cols;
+    const bool half = m_layout == HalfSpectrum;
+
+    // Frequencies as fractions of the Nyquist frequency, negative past it
+    QVector<float> u(m_spectrumCols);
+    for (int c = 0; c < m_spectrumCols; ++c)
+        u[c] = (c <= m_cols / 2 ? c : c - m_cols) / (0.5f * m_cols);
+
+    Complex *filtered = m_pool->acquire<Complex>(half ? spectrumSize() : size);
+
+    Parallel::forRange(m_rows, kRenderGrain, m_threadCount, [&](int begin, int end) {
+        for (int r = begin; r < end; ++r) {
+            const float v = (r <= m_rows / 2 ? r : r - m_rows) / (0.5f * m_rows);
+            const Complex *input = fourier + r * m_spectrumCols;
+            Complex *output = filtered + r * m_spectrumCols;
+
+            if (filters.isEmpty())
+                memcpy(output, input, m_spectrumCols * sizeof(Complex));
+            for (int f = 0; f < filters.size(); ++f) {
+                filters[f].apply(input, output, u.constData(), v, m_spectrumCols);
+                input = output;
+            }
+        }
+    });
+
+    FImage image;
+    if (half) {
+        float *real = m_pool->acquire<float>(size);
+        calculateRealInverseInto(filtered, real);
+        image = quantizedImage(m_pool.data(), m_cols, m_rows, [&](unsigned i) {
+            return (uchar)qBound(0.0f, real[i], 255.0f);
+        });
+        m_pool->release(real);
+    } else {
+        transformInPlace(filtered, true);
+        image = quantizedImage(m_pool.data(), m_cols, m_rows, [&](unsigned i) {
+            return (uchar)qBound(0.0f, filtered[i].real, 255.0f);
+        });
+    }
+
+    m_pool->release(filtered);
+
+    return image;
+}
+
+FImage FT::filteredImage(const SpectrumFilter &filter)
+{
+    return filteredImage(QVector<SpectrumFilter>() << filter);
 }
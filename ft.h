@@ -3,13 +3,23 @@
 
 #include <QDebug>
 #include <QObject>
+#include <QSharedPointer>
+#include <QVector>
 #include <QtMath>
 
+#include "spectrumstorage.h"
+
 #define IS_POWER_OF_TWO(x) ((x != 0) && !(x & (x - 1)))
 
+class BufferPool;
 class FImage;
+class QRect;
+class SpectrumFile;
+class SpectrumFilter;
 
 struct Complex {
+    typedef float Scalar;
+
     float real;
     float imag;
 
@@ -22,6 +32,17 @@ struct Complex {
 
 QDebug operator<<(QDebug, const Complex &);
 
+// Element type of the double precision engines
+struct ComplexDouble {
+    typedef double Scalar;
+
+    double real;
+    double imag;
+
+    ComplexDouble();
+    ComplexDouble(double, double);
+};
+
 class FT : public QObject {
     Q_OBJECT
 public:
@@ -30,38 +51,173 @@ public:
         DFTGPU,
         FFTCPU,
         FFTGPU,
+        MIXEDFFTCPU,
+        REALFFTCPU,
+        RADIX4FFTCPU,
+        STOCKHAMFFTCPU,
+        MIXEDFFTCPUDOUBLE,
+        SEPARABLEDFTCPU,
         FTTYPECOUNT
     };
 
+    // What init() computes besides the spectrum. Whatever is not requested
+    // there is computed on first use instead; magnitude and phase asked for
+    // together come from a single pass over the spectrum.
+    enum Output {
+        SpectrumOutput = 0x0,
+        MagnitudeOutput = 0x1,
+        PhaseOutput = 0x2,
+        PolarOutput = MagnitudeOutput | PhaseOutput
+    };
+
+    // HalfSpectrum keeps only the non-redundant m_cols / 2 + 1 columns of
+    // the spectrum of a real image; the rest follows from Hermitian symmetry.
+    enum SpectrumLayout {
+        FullSpectrum = 0,
+        HalfSpectrum
+    };
+
     static FT *createFT(FTType, FImage *);
 
+    // An engine of the given type over a spectrum written by save(). If the
+    // file has the engine's layout its sections are used in place, mapped
+    // rather than read; otherwise the spectrum is converted. The engine's
+    // image is blank, so only the outputs and reconstructions are useful.
+    static FT *load(FTType, const QString &path);
+
     explicit FT(QObject *parent = 0);
     explicit FT(FImage *image, QObject *parent = 0);
     virtual ~FT();
 
-    int init();
+    // Returns the milliseconds spent on the spectrum and the requested
+    // outputs
+    int init(int outputs = SpectrumOutput);
     int bench();
 
-    FImage magnitudeImage() const;
+    // Replaces the image with another of the same size, keeping every buffer;
+    // the next init() transforms it
+    void setImageData(const uchar *values);
+
+    // setImageData() and init() for values that differ from the image of
+    // the last init() only inside region. A small region updates the
+    // spectrum by the transform of the change, bin by bin, at a cost of
+    // about region height * spectrum width * (region width + rows); larger
+    // ones, or a spectrum that is not from this image, are transformed whole.
+    int updateImageData(const uchar *values, const QRect &region, int outputs = SpectrumOutput);
+
+    // Writes the spectrum of the last init() to a spectrum file, with the
+    // magnitude and phase if they are computed; see SpectrumFile
+    bool save(const QString &path);
+
+    // FImage::id() of the image the spectrum was computed from
+    QString sourceId() const;
+
+    FImage magnitudeImage();
     FImage reconstructFromMagnitude();
-    FImage phaseImage() const;
+    FImage phaseImage();
     FImage reconstructFromPhase();
     FImage reconstructOriginalImage();
 
+    // Any of the three reconstructions above, which may each be 0, from one
+    // batch of inverse transforms
+    void reconstruct(FImage *fromMagnitude, FImage *fromPhase, FImage *original);
+
+    // The image of the spectrum from init() times all of filters, from a
+    // single inverse transform. The masks are applied while the spectrum is
+    // copied for it, so the stored spectrum is left as it is and trying
+    // other filters costs no forward transform.
+    FImage filteredImage(const QVector<SpectrumFilter> &filters);
+    FImage filteredImage(const SpectrumFilter &filter);
+
+    SpectrumLayout spectrumLayout() const;
+    virtual QString variant() const;
+
+    int threadCount() const;
+    void setThreadCount(int);
+
+    // Transform of an image-sized buffer into caller-owned memory; output may
+    // be input itself. Engines that override calculateFourierInto() do not
+    // allocate once their scratch buffers have grown to the image size.
+    void transform(const Complex *input, Complex *output, bool inverse = false);
+    void transformInPlace(Complex *data, bool inverse = false);
+
+    // count such transforms run as one batch; outputs[i] may be inputs[i]
+    void transformBatch(const Complex *const *inputs, Complex *const *outputs, int count, bool inverse = false);
+
+    // Spectrum of a real image-sized buffer in the engine's layout, rows of
+    // m_cols / 2 + 1 values for HalfSpectrum, and the real image of such a
+    // spectrum; the half spectrum engines run these at half the cost
+    void transformReal(const float *input, Complex *spectrum);
+    void inverseTransformReal(const Complex *spectrum, float *output);
+
+    // Format the spectrum is kept in after init(). The compact formats are
+    // unpacked to float whenever the spectrum is transformed back, or when
+    // an output not requested from init() is computed later.
+    SpectrumStorage::Format storageFormat() const;
+    void setStorageFormat(SpectrumStorage::Format);
+
+    // Relative RMS error of this engine's spectrum of the image against
+    // reference, a full spectrum computed in double, after a round trip
+    // through each storage format, indexed by format. The spectrum is
+    // computed once for all of them.
+    QVector<double> spectrumErrors(const ComplexDouble *reference);
+
 protected:
-    virtual Complex *calculateFourier(Complex *input, bool inverse) = 0;
-    float *calculateMagnitude(Complex *) const;
-    float *calculatePhase(Complex *) const;
+    FT(FImage *image, SpectrumLayout layout, QObject *parent = 0);
 
-    template <typename T> T *fftshift(const T *input, bool inverse = false) const;
+    virtual Complex *calculateFourier(Complex *input, bool inverse) = 0;
+    virtual void calculateFourierInto(const Complex *input, Complex *output, bool inverse);
+    virtual void calculateFourierBatchInto(const Complex *const *inputs, Complex *const *outputs,
+                                           int count, bool inverse);
+    virtual void calculateRealFourierInto(const float *input, Complex *output);
+    virtual void calculateRealInverseInto(const Complex *spectrum, float *output);
+    float *calculateMagnitude(const Complex *, unsigned size) const;
+    float *calculatePhase(const Complex *, unsigned size) const;
+    void calculateMagnitude(const Complex *, float *, unsigned size) const;
+    void calculatePhase(const Complex *, float *, unsigned size) const;
+    void calculatePolar(const Complex *, float *magnitude, float *phase, unsigned size) const;
+
+    unsigned spectrumSize() const;
+    void expandHalfSpectrum(const float *input, float *output, float mirrorSign) const;
+    void expandHalfSpectrum(const Complex *input, Complex *output) const;
+
+    template <typename Pixel>
+    void renderSpectrum(FImage &image, const Complex *fourier, const Pixel &pixel) const;
+
+    Complex *scratch();
+    const Complex *spectrum();
+    void packSpectrum();
+
+    const float *magnitude();
+    const float *phase();
+    void computeOutputs(int outputs);
 
     int m_rows;
     int m_cols;
+    SpectrumLayout m_layout;
+    int m_spectrumCols;
+    int m_threadCount;
+    QSharedPointer<BufferPool> m_pool;
     Complex *m_imageData;
+    float *m_realData;
 
     Complex *m_fourier;
     float *m_magnitude;
     float *m_phase;
+
+private:
+    void attachFile(SpectrumFile *);
+    void detachFile(bool keepValues);
+    bool directUpdateCheaper(const QRect &region) const;
+    void updateSpectrum(const uchar *values, const QRect &region);
+
+    QString m_sourceId;
+    SpectrumFile *m_file;
+    Complex *m_scratch;
+    int m_validOutputs;
+    bool m_imageTransformed;
+    SpectrumStorage::Format m_storageFormat;
+    void *m_packedFourier;
 };
 
 #endif // FT_H
@@ -0,0 +1,167 @@
+#include "ftbatch.h"
+
+#include <string.h>
+
+#include "bufferpool.h"
+#include "fimage.h"
+#include "parallel.h"
+
+// Rows handed to a thread at a time when packing and splitting
+static const int kGrain = 8;
+
+static const int kDefaultChunkSize = 16;
+
+FTBatch::FTBatch(FT::FTType type, int cols, int rows)
+    : m_cols(cols)
+    , m_rows(rows)
+    , m_chunkSize(kDefaultChunkSize)
+    , m_pool(BufferPool::forSize(cols, rows))
+    , m_pairs(0)
+    , m_spectra(0)
+    , m_bufferChunk(0)
+{
+    // One engine for the whole batch, built on a blank image of its size
+    FImage blank(cols, rows);
+    m_ft.reset(FT::createFT(type, &blank));
+    if (!m_ft)
+        qWarning("[ERROR] Unknown FT type %d", type);
+}
+
+FTBatch::~FTBatch()
+{
+    m_pool->release(m_pairs);
+    m_pool->release(m_spectra);
+}
+
+bool FTBatch::isValid() const
+{
+    return !m_ft.isNull();
+}
+
+FT::SpectrumLayout FTBatch::spectrumLayout() const
+{
+    return m_ft ? m_ft->spectrumLayout() : FT::FullSpectrum;
+}
+
+int FTBatch::spectrumCols() const
+{
+    return spectrumLayout() == FT::HalfSpectrum ? m_cols / 2 + 1 : m_cols;
+}
+
+unsigned FTBatch::spectrumSize() const
+{
+    return m_rows * spectrumCols();
+}
+
+int FTBatch::chunkSize() const
+{
+    return m_chunkSize;
+}
+
+void FTBatch::setChunkSize(int chunkSize)
+{
+    m_chunkSize = qMax(1, chunkSize);
+}
+
+int FTBatch::threadCount() const
+{
+    return m_ft ? m_ft->threadCount() : 1;
+}
+
+void FTBatch::setThreadCount(int threads)
+{
+    if (m_ft)
+        m_ft->setThreadCount(threads);
+}
+
+QVector<QVector<Complex> > FTBatch::transform(const QList<FImage> &images)
+{
+    QVector<QVector<uchar> > data;
+    QVector<const uchar *> values;
+    data.reserve(images.size());
+    values.reserve(images.size());
+
+    for (int i = 0; i < images.size(); ++i) {
+        if (images[i].width() != m_cols || images[i].height() != m_rows) {
+            qWarning("Image %d is not %dx%d", i, m_cols, m_rows);
+            return QVector<QVector<Complex> >();
+        }
+
+        data.append(images[i].data());
+        values.append(data.last().constData());
+    }
+
+    const unsigned size = spectrumSize();
+    QVector<QVector<Complex> > spectra(images.size());
+    transform(values.constData(), values.size(), [&](int index, const Complex *spectrum) {
+        spectra[index] = QVector<Complex>(size);
+        memcpy(spectra[index].data(), spectrum, size * sizeof(Complex));
+    });
+
+    return spectra;
+}
+
+void FTBatch::transformChunk(const uchar *const *images, int count)
+{
+    const unsigned size = m_cols * m_rows;
+    const unsigned outputSize = spectrumSize();
+    const int outputCols = spectrumCols();
+    const int pairs = (count + 1) / 2;
+
+    if (m_bufferChunk < m_chunkSize) {
+        m_pool->release(m_pairs);
+        m_pool->release(m_spectra);
+        m_pairs = m_pool->acquire<Complex>((m_chunkSize + 1) / 2 * size);
+        m_spectra = m_pool->acquire<Complex>(m_chunkSize * outputSize);
+        m_bufferChunk = m_chunkSize;
+    }
+
+    Parallel::forRange(pairs * m_rows, kGrain, threadCount(), [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const int pair = i / m_rows;
+            const int y = i - pair * m_rows;
+
+            const uchar *a = images[2 * pair] + y * m_cols;
+            const uchar *b = 2 * pair + 1 < count ? images[2 * pair + 1] + y * m_cols : 0;
+            Complex *z = m_pairs + pair * size + y * m_cols;
+
+            for (int x = 0; x < m_cols; ++x)
+                z[x] = Complex(a[x], b ? b[x] : 0.0);
+        }
+    });
+
+    QVector<Complex *> buffers(pairs);
+    for (int pair = 0; pair < pairs; ++pair)
+        buffers[pair] = m_pairs + pair * size;
+    m_ft->transformBatch(buffers.constData(), buffers.constData(), pairs, false);
+
+    Parallel::forRange(pairs * m_rows, kGrain, threadCount(), [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            const int pair = i / m_rows;
+            const int y = i - pair * m_rows;
+            const int mirrorY = y ? m_rows - y : 0;
+
+            const Complex *row = m_pairs + pair * size + y * m_cols;
+            const Complex *mirrorRow = m_pairs + pair * size + mirrorY * m_cols;
+            Complex *outA = m_spectra + 2 * pair * outputSize + y * outputCols;
+            Complex *outB = 2 * pair + 1 < count ? outA + outputSize : 0;
+
+            for (int x = 0; x < outputCols; ++x) {
+                const Complex z = row[x];
+                const Complex m = mirrorRow[x ? m_cols - x : 0];
+
+                outA[x].real = 0.5 * (z.real + m.real);
+                outA[x].imag = 0.5 * (z.imag - m.imag);
+                if (outB) {
+                    outB[x].real = 0.5 * (z.imag + m.imag);
+                    outB[x].imag = -0.5 * (z.real - m.real);
+                }
+            }
+        }
+    });
+}
+
+const Complex *FTBatch::spectrum(int index) const
+{
+    return m_spectra + index * spectrumSize();
+}
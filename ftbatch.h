@@ -0,0 +1,78 @@
+#ifndef FTBATCH_H
+#define FTBATCH_H
+
+#include <QList>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QVector>
+
+#include "ft.h"
+
+class BufferPool;
+
+// Transforms many gray images of one size with a single engine, so plans,
+// pooled buffers and the GPU context are set up once rather than per image.
+// Images are taken two at a time as a + ib and run through the engine's
+// batched transform a chunk at a time; the two spectra are then split using
+// A[k] = (Z[k] + Z*[-k]) / 2 and B[k] = (Z[k] - Z*[-k]) / 2i. Spectra come in
+// the engine's layout, spectrumCols() columns by rows.
+class FTBatch {
+public:
+    FTBatch(FT::FTType, int cols, int rows);
+    ~FTBatch();
+
+    bool isValid() const;
+
+    FT::SpectrumLayout spectrumLayout() const;
+    int spectrumCols() const;
+    unsigned spectrumSize() const;
+
+    // Images transformed per engine call; larger chunks share more of each
+    // pass and kernel launch, at the cost of chunk-sized buffers
+    int chunkSize() const;
+    void setChunkSize(int);
+
+    int threadCount() const;
+    void setThreadCount(int);
+
+    // Calls callback(index, spectrum) for each of the count images in order,
+    // as soon as the chunk holding it is done. The spectrum is only valid
+    // during the call.
+    template <typename Callback>
+    void transform(const uchar *const *images, int count, const Callback &callback);
+
+    QVector<QVector<Complex> > transform(const QList<FImage> &images);
+
+private:
+    Q_DISABLE_COPY(FTBatch)
+
+    void transformChunk(const uchar *const *images, int count);
+    const Complex *spectrum(int index) const;
+
+    int m_cols;
+    int m_rows;
+    int m_chunkSize;
+    QScopedPointer<FT> m_ft;
+    QSharedPointer<BufferPool> m_pool;
+
+    Complex *m_pairs;
+    Complex *m_spectra;
+    int m_bufferChunk;
+};
+
+template <typename Callback>
+void FTBatch::transform(const uchar *const *images, int count, const Callback &callback)
+{
+    if (!isValid())
+        return;
+
+    for (int first = 0; first < count; first += m_chunkSize) {
+        const int chunk = qMin(m_chunkSize, count - first);
+        transformChunk(images + first, chunk);
+
+        for (int i = 0; i < chunk; ++i)
+            callback(first + i, spectrum(i));
+    }
+}
+
+#endif // FTBATCH_H
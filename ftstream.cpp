@@ -0,0 +1,180 @@
+#include "ftstream.h"
+
+#include <string.h>
+
+#include <QMutexLocker>
+#include <QThread>
+
+class FTStream::Stage : public QThread {
+public:
+    typedef void (FTStream::*Function)();
+
+    Stage(FTStream *stream, Function function)
+        : m_stream(stream)
+        , m_function(function)
+    {
+    }
+
+protected:
+    void run()
+    {
+        (m_stream->*m_function)();
+    }
+
+private:
+    FTStream *m_stream;
+    Function m_function;
+};
+
+FTStream::Slot::Slot()
+    : ft(0)
+    , cols(0)
+    , rows(0)
+    , pushed(0)
+    , convertNs(0)
+    , transformNs(0)
+    , renderNs(0)
+    , latencyNs(0)
+{
+}
+
+FTStream::FTStream(FT::FTType type, int depth)
+    : m_type(type)
+    , m_slots(qMax(1, depth))
+    , m_free(m_slots.size())
+    , m_pushed(0)
+    , m_taken(0)
+    , m_transformStage(new Stage(this, &FTStream::runTransform))
+    , m_renderStage(new Stage(this, &FTStream::runRender))
+    , m_firstPush(-1)
+{
+    memset(&m_statistics, 0, sizeof(m_statistics));
+
+    m_clock.start();
+    m_transformStage->start();
+    m_renderStage->start();
+}
+
+// A release without a frame behind it is the signal to stop; each stage
+// passes it on once the frames before it are done.
+FTStream::~FTStream()
+{
+    m_converted.release();
+    m_transformStage->wait();
+    m_renderStage->wait();
+    delete m_transformStage;
+    delete m_renderStage;
+
+    for (int i = 0; i < m_slots.size(); ++i)
+        delete m_slots[i].ft;
+}
+
+int FTStream::depth() const
+{
+    return m_slots.size();
+}
+
+bool FTStream::push(const FImage &frame)
+{
+    m_free.acquire();
+
+    const int index = m_pushed.load();
+    Slot &slot = m_slots[index % m_slots.size()];
+    slot.pushed = m_clock.nsecsElapsed();
+
+    if (!slot.ft || slot.cols != frame.width() || slot.rows != frame.height()) {
+        delete slot.ft;
+        slot.ft = FT::createFT(m_type, const_cast<FImage *>(&frame));
+        if (!slot.ft) {
+            qWarning("[ERROR] Unknown FT type %d", m_type);
+            m_free.release();
+            return false;
+        }
+        slot.cols = frame.width();
+        slot.rows = frame.height();
+    } else {
+        slot.ft->setImageData(frame.data().constData());
+    }
+    slot.convertNs = m_clock.nsecsElapsed() - slot.pushed;
+
+    {
+        QMutexLocker locker(&m_statisticsMutex);
+        if (m_firstPush < 0)
+            m_firstPush = slot.pushed;
+    }
+
+    m_pushed.store(index + 1);
+    m_converted.release();
+
+    return true;
+}
+
+FImage FTStream::take()
+{
+    m_rendered.acquire();
+
+    Slot &slot = m_slots[m_taken % m_slots.size()];
+    FImage image = slot.image;
+    slot.image = FImage();
+    ++m_taken;
+
+    {
+        QMutexLocker locker(&m_statisticsMutex);
+        Statistics &s = m_statistics;
+        const double n = s.frames++;
+
+        s.convertMs = (s.convertMs * n + slot.convertNs * 1e-6) / s.frames;
+        s.transformMs = (s.transformMs * n + slot.transformNs * 1e-6) / s.frames;
+        s.renderMs = (s.renderMs * n + slot.renderNs * 1e-6) / s.frames;
+        s.latencyMs = (s.latencyMs * n + slot.latencyNs * 1e-6) / s.frames;
+
+        const qint64 elapsed = m_clock.nsecsElapsed() - m_firstPush;
+        s.framesPerSecond = elapsed > 0 ? s.frames * 1e9 / elapsed : 0.0;
+    }
+
+    m_free.release();
+
+    return image;
+}
+
+FTStream::Statistics FTStream::statistics() const
+{
+    QMutexLocker locker(&m_statisticsMutex);
+    return m_statistics;
+}
+
+void FTStream::runTransform()
+{
+    for (int index = 0;; ++index) {
+        m_converted.acquire();
+        if (index == m_pushed.load()) {
+            m_transformed.release();
+            return;
+        }
+
+        Slot &slot = m_slots[index % m_slots.size()];
+        const qint64 start = m_clock.nsecsElapsed();
+        slot.ft->init();
+        slot.transformNs = m_clock.nsecsElapsed() - start;
+
+        m_transformed.release();
+    }
+}
+
+void FTStream::runRender()
+{
+    for (int index = 0;; ++index) {
+        m_transformed.acquire();
+        if (index == m_pushed.load())
+            return;
+
+        Slot &slot = m_slots[index % m_slots.size()];
+        const qint64 start = m_clock.nsecsElapsed();
+        slot.image = slot.ft->magnitudeImage();
+        const qint64 end = m_clock.nsecsElapsed();
+        slot.renderNs = end - start;
+        slot.latencyNs = end - slot.pushed;
+
+        m_rendered.release();
+    }
+}
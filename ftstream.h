@@ -0,0 +1,90 @@
+#ifndef FTSTREAM_H
+#define FTSTREAM_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QSemaphore>
+#include <QVector>
+
+#include "fimage.h"
+#include "ft.h"
+
+// Magnitude spectra of a stream of frames, e.g. from a camera. Frames move
+// through depth slots, each with an engine that is kept for as long as the
+// frame size stays the same: push() converts a frame into a free slot on the
+// caller's thread, a transform thread computes its spectrum and a render
+// thread its magnitude image, and take() hands the images out in push order
+// and frees the slot. With three slots all three stages run at once.
+class FTStream {
+public:
+    struct Statistics {
+        int frames;
+        double framesPerSecond;
+
+        // Average milliseconds per frame in each stage, and from push()
+        // until the image is rendered
+        double convertMs;
+        double transformMs;
+        double renderMs;
+        double latencyMs;
+    };
+
+    explicit FTStream(FT::FTType type, int depth = 3);
+    ~FTStream();
+
+    int depth() const;
+
+    // Blocks while every slot holds a frame that is not taken yet. Returns
+    // false, and queues nothing, if no engine of the type can be created.
+    bool push(const FImage &frame);
+
+    // Blocks until the oldest frame not taken yet is rendered
+    FImage take();
+
+    // Over the frames taken so far
+    Statistics statistics() const;
+
+private:
+    Q_DISABLE_COPY(FTStream)
+
+    class Stage;
+
+    struct Slot {
+        Slot();
+
+        FT *ft;
+        int cols;
+        int rows;
+        FImage image;
+
+        qint64 pushed;
+        qint64 convertNs;
+        qint64 transformNs;
+        qint64 renderNs;
+        qint64 latencyNs;
+    };
+
+    void runTransform();
+    void runRender();
+
+    FT::FTType m_type;
+    QVector<Slot> m_slots;
+    QElapsedTimer m_clock;
+
+    QSemaphore m_free;
+    QSemaphore m_converted;
+    QSemaphore m_transformed;
+    QSemaphore m_rendered;
+    QAtomicInt m_pushed;
+    int m_taken;
+
+    Stage *m_transformStage;
+    Stage *m_renderStage;
+
+    mutable QMutex m_statisticsMutex;
+    Statistics m_statistics;
+    qint64 m_firstPush;
+};
+
+#endif // FTSTREAM_H
@@ -189,12 +189,17 @@ void GPU::releaseOutputArgs(const QString &kernelId)
         cl_mem clOutput = outputArgs[i].first;
         void *output = outputArgs[i].second;
 
+        // A buffer that cannot be read is still released, so no argument
+        // outlives the call
         size_t size = 0;
         m_clError = clGetMemObjectInfo(clOutput, CL_MEM_SIZE, sizeof(size), &size, 0);
-        CHECK_CL_ERROR("[ERROR] Unable to acquire OpenCL Output Buffer size");
-
-        m_clError = clEnqueueReadBuffer(m_clCommandQueue, clOutput, CL_TRUE, 0, size, output, 0, 0, 0);
-        CHECK_CL_ERROR("[ERROR] Unable to read from OpenCL Output Buffer");
+        if (m_clError != CL_SUCCESS) {
+            qWarning("[ERROR] Unable to acquire OpenCL Output Buffer size: %d", m_clError);
+        } else {
+            m_clError = clEnqueueReadBuffer(m_clCommandQueue, clOutput, CL_TRUE, 0, size, output, 0, 0, 0);
+            if (m_clError != CL_SUCCESS)
+                qWarning("[ERROR] Unable to read from OpenCL Output Buffer: %d", m_clError);
+        }
 
         clReleaseMemObject(clOutput);
     }
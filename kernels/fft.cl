@@ -66,13 +66,17 @@ __kernel void fft1DRow(__global float2 *fourier,
         fourier[i + (row * WIDTH)] = vector[i];
 }
 
+// Images of a batch follow one another in fourier; fft1DRow needs no
+// change for that, as their rows are simply consecutive.
 __kernel void fft1DCol(__global float2 *fourier,
                        const float dir,
                        const float norm)
 {
-    unsigned col = get_global_id(0);
+    unsigned col = get_global_id(0) % WIDTH;
     float2 vector[HEIGHT];
 
+    fourier += (get_global_id(0) / WIDTH) * WIDTH * HEIGHT;
+
     vector[0] = fourier[col];
     vector[HEIGHT - 1] = fourier[col + (HEIGHT - 1) * WIDTH];
 
@@ -2,12 +2,17 @@
 #include "ui_mainwindow.h"
 
 #include <algorithm>
+#include <QElapsedTimer>
 #include <QFileDialog>
 #include <QFontDatabase>
 #include <QProgressDialog>
 
+#include "bufferpool.h"
+#include "convolution.h"
 #include "fimage.h"
 #include "ft.h"
+#include "mixedfftcpu.h"
+#include "parallel.h"
 #include "rectdialog.h"
 
 MainWindow::MainWindow(QWidget *parent)
@@ -39,6 +44,24 @@ MainWindow::MainWindow(QWidget *parent)
         case FT::FFTGPU:
             text = QStringLiteral("FFT GPU");
             break;
+        case FT::MIXEDFFTCPU:
+            text = QStringLiteral("Mixed FFT CPU");
+            break;
+        case FT::REALFFTCPU:
+            text = QStringLiteral("Real FFT CPU");
+            break;
+        case FT::RADIX4FFTCPU:
+            text = QStringLiteral("Radix-4 FFT CPU");
+            break;
+        case FT::STOCKHAMFFTCPU:
+            text = QStringLiteral("Stockham FFT CPU");
+            break;
+        case FT::MIXEDFFTCPUDOUBLE:
+            text = QStringLiteral("Mixed FFT CPU (double)");
+            break;
+        case FT::SEPARABLEDFTCPU:
+            text = QStringLiteral("Separable DFT CPU");
+            break;
         default:
             text = QStringLiteral("Unknown");
         }
@@ -53,6 +76,7 @@ MainWindow::MainWindow(QWidget *parent)
     ui->modFtCombo->setCurrentIndex(FT::FFTGPU);
     ui->modElapsedLabel->setStyleSheet("QLabel { color: red; }");
     ui->benchFtCombo->setCurrentIndex(FT::FFTGPU);
+    ui->benchThreadsSB->setValue(Parallel::idealThreadCount());
 
     ui->compareInputLine->setText(QStringLiteral(":/images/qt-logo-128.png"));
     ui->benchInputLine->setText(QStringLiteral("rect-128-128-32-16-50-200"));
@@ -151,7 +175,7 @@ void MainWindow::startCompare()
 
     m_progress->setValue(10 * progressStep);
     FT *fourierRef = FT::createFT((FT::FTType)ui->refFtCombo->currentIndex(), &image);
-    elapsed = fourierRef->init();
+    elapsed = fourierRef->init(FT::PolarOutput);
     ui->refElapsedLabel->setText(QString("%1 ms").arg(QString::number(elapsed)));
     m_progress->setValue(20 * progressStep);
 
@@ -161,7 +185,10 @@ void MainWindow::startCompare()
     ui->magnitudeImageRef->setFixedSize(magnitudePixmapRef.size());
     m_progress->setValue(30 * progressStep);
 
-    FImage recMagnitudeImageRef = fourierRef->reconstructFromMagnitude();
+    // All three reconstructions come from one batch of inverse transforms
+    FImage recMagnitudeImageRef, recPhaseImageRef, recOriginalImageRef;
+    fourierRef->reconstruct(&recMagnitudeImageRef, &recPhaseImageRef, &recOriginalImageRef);
+
     QPixmap recMagnitudePixmapRef = QPixmap::fromImage(recMagnitudeImageRef);
     ui->recMagnitudeImageRef->setPixmap(recMagnitudePixmapRef);
     ui->recMagnitudeImageRef->setFixedSize(recMagnitudePixmapRef.size());
@@ -173,13 +200,11 @@ void MainWindow::startCompare()
     ui->phaseImageRef->setFixedSize(phasePixmapRef.size());
     m_progress->setValue(50 * progressStep);
 
-    FImage recPhaseImageRef = fourierRef->reconstructFromPhase();
     QPixmap recPhasePixmapRef = QPixmap::fromImage(recPhaseImageRef);
     ui->recPhaseImageRef->setPixmap(recPhasePixmapRef);
     ui->recPhaseImageRef->setFixedSize(recPhasePixmapRef.size());
     m_progress->setValue(60 * progressStep);
 
-    FImage recOriginalImageRef = fourierRef->reconstructOriginalImage();
     QPixmap recOriginalPixmapRef = QPixmap::fromImage(recOriginalImageRef);
     ui->recOriginalImageRef->setPixmap(recOriginalPixmapRef);
     ui->recOriginalImageRef->setFixedSize(recOriginalPixmapRef.size());
@@ -189,7 +214,7 @@ void MainWindow::startCompare()
 
 
     FT *fourierMod = FT::createFT((FT::FTType)ui->modFtCombo->currentIndex(), &image);
-    elapsed = fourierMod->init();
+    elapsed = fourierMod->init(FT::PolarOutput);
     ui->modElapsedLabel->setText(QString("%1 ms").arg(QString::number(elapsed)));
     m_progress->setValue(80 * progressStep);
 
@@ -199,7 +224,9 @@ void MainWindow::startCompare()
     ui->magnitudeImageMod->setFixedSize(magnitudePixmapMod.size());
     m_progress->setValue(90 * progressStep);
 
-    FImage recMagnitudeImageMod = fourierMod->reconstructFromMagnitude();
+    FImage recMagnitudeImageMod, recPhaseImageMod, recOriginalImageMod;
+    fourierMod->reconstruct(&recMagnitudeImageMod, &recPhaseImageMod, &recOriginalImageMod);
+
     QPixmap recMagnitudePixmapMod = QPixmap::fromImage(recMagnitudeImageMod);
     ui->recMagnitudeImageMod->setPixmap(recMagnitudePixmapMod);
     ui->recMagnitudeImageMod->setFixedSize(recMagnitudePixmapMod.size());
@@ -211,13 +238,11 @@ void MainWindow::startCompare()
     ui->phaseImageMod->setFixedSize(phasePixmapMod.size());
     m_progress->setValue(110 * progressStep);
 
-    FImage recPhaseImageMod = fourierMod->reconstructFromPhase();
     QPixmap recPhasePixmapMod = QPixmap::fromImage(recPhaseImageMod);
     ui->recPhaseImageMod->setPixmap(recPhasePixmapMod);
     ui->recPhaseImageMod->setFixedSize(recPhasePixmapMod.size());
     m_progress->setValue(120 * progressStep);
 
-    FImage recOriginalImageMod = fourierMod->reconstructOriginalImage();
     QPixmap recOriginalPixmapMod = QPixmap::fromImage(recOriginalImageMod);
     ui->recOriginalImageMod->setPixmap(recOriginalPixmapMod);
     ui->recOriginalImageMod->setFixedSize(recOriginalPixmapMod.size());
@@ -226,6 +251,74 @@ void MainWindow::startCompare()
     delete fourierMod;
 }
 
+// Longest direct convolution the bench runs, predicted from the previous
+// kernel size
+static const double kMaxDirectMilliseconds = 2000.0;
+
+// Time of one convolution of image by the given method, after a first run
+// that also transforms the kernel
+static double convolutionTime(Convolution &convolution, Convolution::Method method,
+                              const QVector<uchar> &pixels, int cols, int rows, float *output)
+{
+    convolution.setMethod(method);
+    if (method != Convolution::DirectMethod)
+        convolution.apply(pixels.constData(), cols, rows, output);
+
+    QElapsedTimer timer;
+    timer.start();
+    convolution.apply(pixels.constData(), cols, rows, output);
+    return timer.nsecsElapsed() / 1000000.0;
+}
+
+// Direct, whole-image FFT and tiled convolution of image with box kernels of
+// growing size, up to the first one an FFT method is faster for, next to the
+// size Convolution picks an FFT method from. Engines without a fast
+// transform are measured on the mixed-radix engine instead.
+static QString convolutionCrossover(const FImage &image, FT::FTType type, int threads)
+{
+    static const int kernelSizes[] = { 3, 5, 9, 17, 33, 65, 129 };
+    static const int kernelSizeCount = sizeof(kernelSizes) / sizeof(kernelSizes[0]);
+
+    if (!Convolution::hasFastTransform(type))
+        type = FT::MIXEDFFTCPU;
+
+    const int cols = image.width();
+    const int rows = image.height();
+    const QVector<uchar> pixels = image.data();
+    QVector<float> output(pixels.size());
+    QStringList times;
+    int measured = 0;
+    int picked = 0;
+    double directPerKernelValue = 0.0;
+
+    for (int s = 0; s < kernelSizeCount; ++s) {
+        const int k = kernelSizes[s];
+        const QVector<float> kernel(k * k, 1.0f / (k * k));
+        Convolution convolution(kernel.constData(), k, k, Convolution::Convolve, type);
+        convolution.setThreadCount(threads);
+
+        if (!picked && convolution.preferredMethod(cols, rows) != Convolution::DirectMethod)
+            picked = k;
+        if (measured || directPerKernelValue * k * k > kMaxDirectMilliseconds)
+            continue;
+
+        const double direct = convolutionTime(convolution, Convolution::DirectMethod, pixels, cols, rows, output.data());
+        const double fourier = convolutionTime(convolution, Convolution::FourierMethod, pixels, cols, rows, output.data());
+        const double tiled = convolutionTime(convolution, Convolution::TiledMethod, pixels, cols, rows, output.data());
+        directPerKernelValue = direct / (k * k);
+
+        times.append(QStringLiteral("%1:%2/%3/%4").arg(k).arg(QString::number(direct, 'f', 1))
+                     .arg(QString::number(fourier, 'f', 1)).arg(QString::number(tiled, 'f', 1)));
+        if (qMin(fourier, tiled) < direct)
+            measured = k;
+    }
+
+    return QStringLiteral("  convolution direct/fft/tiled ms %1, fft faster from %2, picked from %3")
+        .arg(times.join(" "))
+        .arg(measured ? QString::number(measured) : QStringLiteral("-"))
+        .arg(picked ? QString::number(picked) : QStringLiteral("-"));
+}
+
 void MainWindow::startBench()
 {
     int rangeMin = ui->rangeMinSB->value();
@@ -244,11 +337,13 @@ void MainWindow::startBench()
     float progressCounter;
 
     FT::FTType algorithm = (FT::FTType)ui->benchFtCombo->currentIndex();
+    int threads = ui->benchThreadsSB->value();
 
     QString input = ui->benchInputLine->text();
     Q_ASSERT(FImage::isRectCode(input));
 
     ui->benchResultView->clear();
+    ui->benchResultView->append(QStringLiteral("Threads: %1").arg(threads));
     progressCounter = 0.0;
     m_progress->setValue(progressCounter);
 
@@ -256,14 +351,20 @@ void MainWindow::startBench()
         QVector<int> results;
         FImage rectangle = FImage::rectangle(input, QSize(size, size));
 
+        BufferPool::resetStatistics();
+
         FT *fourierWarmUp = FT::createFT(algorithm, &rectangle);
+        fourierWarmUp->setThreadCount(threads);
         fourierWarmUp->bench();
+        if (size == rangeMin && !fourierWarmUp->variant().isEmpty())
+            ui->benchResultView->append(QStringLiteral("Variant: %1").arg(fourierWarmUp->variant()));
         delete fourierWarmUp;
         progressCounter += progressStep;
         m_progress->setValue(progressCounter);
 
         for (int i = 0; i < iterations; ++i) {
             FT *fourier = FT::createFT(algorithm, &rectangle);
+            fourier->setThreadCount(threads);
             results.append(fourier->bench());
             delete fourier;
 
@@ -289,15 +390,50 @@ void MainWindow::startBench()
         benchSum.append(QString::number(size).rightJustified(4, ' '));
         benchSum.append(QStringLiteral("%1 ms").arg(QString::number(result).rightJustified(4, ' ')));
 
+        // Time spent in the buffer pool over the warm-up and all iterations,
+        // and how many of its buffers had to come from the system
+        const double allocMs = BufferPool::allocatorNanoseconds() / 1000000.0;
+        benchSum.append(QStringLiteral("alloc %1 ms/%2").arg(QString::number(allocMs, 'f', 2)).arg(BufferPool::systemAllocations()));
+
+        // Relative RMS error against a double precision transform, for the
+        // spectrum as computed and after a round trip through each compact
+        // storage format
+        const QVector<uchar> pixels = rectangle.data();
+        QVector<ComplexDouble> reference(pixels.size());
+        for (int i = 0; i < pixels.size(); ++i)
+            reference[i] = ComplexDouble(pixels[i], 0.0);
+
+        MixedFFTCpu<ComplexDouble> referenceFourier(&rectangle);
+        referenceFourier.setThreadCount(threads);
+        referenceFourier.transformNative(reference.constData(), reference.data());
+
+        FT *fourierError = FT::createFT(algorithm, &rectangle);
+        fourierError->setThreadCount(threads);
+        const QVector<double> errors = fourierError->spectrumErrors(reference.constData());
+        for (int f = 0; f < SpectrumStorage::FORMATCOUNT; ++f) {
+            const SpectrumStorage::Format format = (SpectrumStorage::Format)f;
+            benchSum.append(QStringLiteral("%1 %2").arg(SpectrumStorage::name(format)).arg(QString::number(errors[f], 'e', 1)));
+        }
+        delete fourierError;
+
         QStringList resultList;
         Q_FOREACH (int r, results)
             resultList.append(QString::number(r).rightJustified(4, ' '));
 
         ui->benchResultView->append(QStringLiteral("%1\t%2").arg(benchSum.join(" ")).arg(resultList.join(" ")));
+        ui->benchResultView->append(convolutionCrossover(rectangle, algorithm, threads));
+
+        // Nothing of this size is used again, so its buffers are not kept
+        BufferPool::trim();
 
         progressCounter += progressStep;
         m_progress->setValue(progressCounter);
     }
 
+    const double mb = 1024.0 * 1024.0;
+    ui->benchResultView->append(QStringLiteral("Peak RSS: %1 MB, pooled: %2 MB")
+                                .arg(QString::number(BufferPool::peakResidentBytes() / mb, 'f', 1))
+                                .arg(QString::number(BufferPool::pooledBytes() / mb, 'f', 1)));
+
     m_progress->setValue(100);
 }
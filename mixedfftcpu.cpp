@@ -0,0 +1,153 @@
+#include "mixedfftcpu.h"
+
+#include "bufferpool.h"
+#include "mixedfftplan.h"
+#include "parallel.h"
+
+// Number of rows or columns transformed together as interleaved sequences
+static const int kBlock = 16;
+
+template <typename C>
+MixedFFTCpu<C>::MixedFFTCpu(FImage *image, QObject *parent)
+    : FT(image, parent)
+    , m_spectrum(0)
+{
+}
+
+template <typename C>
+MixedFFTCpu<C>::~MixedFFTCpu()
+{
+    for (int i = 0; i < m_scratch.size(); ++i)
+        m_pool->release(m_scratch[i].first);
+    m_pool->release(m_spectrum);
+}
+
+template <typename C>
+QString MixedFFTCpu<C>::variant() const
+{
+    return sizeof(typename C::Scalar) == sizeof(double) ? QStringLiteral("double precision") : QString();
+}
+
+template <typename C>
+Complex *MixedFFTCpu<C>::calculateFourier(Complex *input, bool inverse)
+{
+    Complex *fourier = new Complex[m_rows * m_cols];
+    calculateFourierInto(input, fourier, inverse);
+
+    return fourier;
+}
+
+template <typename C>
+void MixedFFTCpu<C>::calculateFourierInto(const Complex *input, Complex *output, bool inverse)
+{
+    transformInto(input, spectrumBuffer(output), output, inverse);
+}
+
+template <typename C>
+void MixedFFTCpu<C>::transformNative(const C *input, C *output, bool inverse)
+{
+    transformInto(input, output, output, inverse);
+}
+
+// The row pass writes into spectrum and the column pass reads it back, so
+// that has to be in the engine's precision; output then only receives the
+// normalized result. A block of rows is copied into scratch before its
+// output rows are written, so spectrum and output may alias input.
+template <typename C>
+template <typename In, typename Out>
+void MixedFFTCpu<C>::transformInto(const In *input, C *spectrum, Out *output, bool inverse)
+{
+    typedef typename C::Scalar Scalar;
+
+    const int size = m_rows * m_cols;
+    const Scalar norm = inverse ? 1.0 / size : 1.0;
+
+    QSharedPointer<const MixedFFTPlan<C> > rowPlan = MixedFFTPlan<C>::plan(m_cols, inverse);
+    QSharedPointer<const MixedFFTPlan<C> > colPlan = MixedFFTPlan<C>::plan(m_rows, inverse);
+
+    const int bufferSize = qMax(rowPlan->bufferSize(), colPlan->bufferSize()) * kBlock;
+    if (m_scratch.size() < m_threadCount)
+        m_scratch.resize(m_threadCount);
+
+    // Both passes transform blocks of interleaved sequences, so the inner
+    // butterfly loop always runs over kBlock contiguous elements, even in the
+    // first stages where a single sequence would have a stride of one.
+    const int rowBlocks = (m_rows + kBlock - 1) / kBlock;
+    Parallel::forRangeIndexed(rowBlocks, 1, m_threadCount, [&](int worker, int begin, int end) {
+        C *work = workerScratch(worker, 2 * bufferSize);
+        C *scratch = work + bufferSize;
+
+        for (int y0 = begin * kBlock; y0 < end * kBlock && y0 < m_rows; y0 += kBlock) {
+            const int block = qMin(kBlock, m_rows - y0);
+
+            for (int y = 0; y < block; ++y) {
+                const In *row = &input[(y0 + y) * m_cols];
+                for (int x = 0; x < m_cols; ++x)
+                    work[y + x * block] = C(row[x].real, row[x].imag);
+            }
+
+            C *rows = rowPlan->execute(work, scratch, block);
+
+            for (int y = 0; y < block; ++y) {
+                C *row = &spectrum[(y0 + y) * m_cols];
+                for (int x = 0; x < m_cols; ++x)
+                    row[x] = rows[y + x * block];
+            }
+        }
+    });
+
+    const int colBlocks = (m_cols + kBlock - 1) / kBlock;
+    Parallel::forRangeIndexed(colBlocks, 1, m_threadCount, [&](int worker, int begin, int end) {
+        C *work = workerScratch(worker, 2 * bufferSize);
+        C *scratch = work + bufferSize;
+
+        for (int x0 = begin * kBlock; x0 < end * kBlock && x0 < m_cols; x0 += kBlock) {
+            const int block = qMin(kBlock, m_cols - x0);
+
+            for (int y = 0; y < m_rows; ++y)
+                memcpy(&work[y * block], &spectrum[x0 + y * m_cols], block * sizeof(C));
+
+            C *columns = colPlan->execute(work, scratch, block);
+
+            for (int y = 0; y < m_rows; ++y) {
+                for (int x = 0; x < block; ++x) {
+                    const C &value = columns[x + y * block];
+                    output[x0 + x + y * m_cols] = Out(value.real * norm, value.imag * norm);
+                }
+            }
+        }
+    });
+}
+
+// The float engine runs its row pass straight into the output
+template <>
+Complex *MixedFFTCpu<Complex>::spectrumBuffer(Complex *output)
+{
+    return output;
+}
+
+template <>
+ComplexDouble *MixedFFTCpu<ComplexDouble>::spectrumBuffer(Complex *)
+{
+    if (!m_spectrum)
+        m_spectrum = m_pool->acquire<ComplexDouble>(m_rows * m_cols);
+
+    return m_spectrum;
+}
+
+// Per-thread scratch, kept between calls like in FFTCpu
+template <typename C>
+C *MixedFFTCpu<C>::workerScratch(int worker, int size)
+{
+    QPair<C *, int> &buffer = m_scratch[worker];
+    if (buffer.second < size) {
+        m_pool->release(buffer.first);
+        buffer.first = m_pool->acquire<C>(size);
+        buffer.second = size;
+    }
+
+    return buffer.first;
+}
+
+template class MixedFFTCpu<Complex>;
+template class MixedFFTCpu<ComplexDouble>;
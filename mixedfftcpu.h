@@ -0,0 +1,38 @@
+#ifndef MIXEDFFTCPU_H
+#define MIXEDFFTCPU_H
+
+#include <QPair>
+#include <QVector>
+
+#include "ft.h"
+
+// C is the precision the transform is computed in, Complex or
+// ComplexDouble. The FT interface stays float either way; the double engine
+// only rounds its final result, and transformNative() skips even that.
+template <typename C>
+class MixedFFTCpu : public FT {
+public:
+    explicit MixedFFTCpu(FImage *image, QObject *parent = 0);
+    ~MixedFFTCpu();
+
+    QString variant() const;
+
+    // Transform of an image-sized buffer in the engine's own precision;
+    // output may be input itself
+    void transformNative(const C *input, C *output, bool inverse = false);
+
+private:
+    Complex *calculateFourier(Complex *input, bool inverse = false);
+    void calculateFourierInto(const Complex *input, Complex *output, bool inverse);
+
+    template <typename In, typename Out>
+    void transformInto(const In *input, C *spectrum, Out *output, bool inverse);
+
+    C *spectrumBuffer(Complex *output);
+    C *workerScratch(int worker, int size);
+
+    QVector<QPair<C *, int> > m_scratch;
+    C *m_spectrum;
+};
+
+#endif // MIXEDFFTCPU_H
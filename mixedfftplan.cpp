@@ -0,0 +1,426 @@
+#include "mixedfftplan.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+
+// Prime factors above this are handled by Bluestein instead of the O(p^2)
+// generic butterfly.
+static const unsigned kMaxRadix = 13;
+
+typedef QPair<unsigned, bool> MixedFFTPlanKey;
+
+template <typename C>
+static inline C add(const C &a, const C &b)
+{
+    return C(a.real + b.real, a.imag + b.imag);
+}
+
+template <typename C>
+static inline C sub(const C &a, const C &b)
+{
+    return C(a.real - b.real, a.imag - b.imag);
+}
+
+template <typename C>
+static inline C mul(const C &a, const C &b)
+{
+    return C(a.real * b.real - a.imag * b.imag, a.imag * b.real + a.real * b.imag);
+}
+
+template <typename C>
+static inline C scale(const C &a, typename C::Scalar s)
+{
+    return C(a.real * s, a.imag * s);
+}
+
+// Multiplies by s * i
+template <typename C>
+static inline C mulImag(const C &a, typename C::Scalar s)
+{
+    return C(-a.imag * s, a.real * s);
+}
+
+// Twiddles are computed in double and rounded once to the plan's precision
+template <typename C>
+static inline C root(double dir, unsigned long long k, unsigned long long n)
+{
+    double angle = dir * 2.0 * M_PI * (double)(k % n) / (double)n;
+    return C((typename C::Scalar)cos(angle), (typename C::Scalar)sin(angle));
+}
+
+template <typename C>
+QSharedPointer<const MixedFFTPlan<C> > MixedFFTPlan<C>::plan(unsigned n, bool inverse)
+{
+    // Recursive, since Bluestein plans request their convolution plans
+    static QMutex mutex(QMutex::Recursive);
+    static QHash<MixedFFTPlanKey, QSharedPointer<const MixedFFTPlan<C> > > cache;
+
+    if (!n)
+        return QSharedPointer<const MixedFFTPlan<C> >();
+
+    QMutexLocker locker(&mutex);
+
+    const MixedFFTPlanKey key(n, inverse);
+    QSharedPointer<const MixedFFTPlan<C> > cached = cache.value(key);
+    if (cached.isNull()) {
+        cached = QSharedPointer<const MixedFFTPlan<C> >(new MixedFFTPlan<C>(n, inverse));
+        cache.insert(key, cached);
+    }
+
+    return cached;
+}
+
+template <typename C>
+MixedFFTPlan<C>::MixedFFTPlan(unsigned n, bool inverse)
+    : m_size(n)
+    , m_inverse(inverse)
+    , m_dir(inverse ? 1.0 : -1.0)
+{
+    QVector<unsigned> factors;
+    unsigned rest = n;
+
+    while (rest % 4 == 0) {
+        factors.append(4);
+        rest /= 4;
+    }
+
+    for (unsigned p = 2; p <= kMaxRadix && rest > 1; ++p) {
+        while (rest % p == 0) {
+            factors.append(p);
+            rest /= p;
+        }
+    }
+
+    if (rest > 1)
+        initBluestein();
+    else
+        initStages(factors);
+}
+
+template <typename C>
+void MixedFFTPlan<C>::initStages(QVector<unsigned> factors)
+{
+    unsigned span = m_size;
+    unsigned stride = 1;
+
+    for (int f = 0; f < factors.size(); ++f) {
+        Stage stage;
+        stage.radix = factors[f];
+        stage.span = span / stage.radix;
+        stage.stride = stride;
+        stage.twiddleOffset = m_twiddles.size();
+        stage.rootOffset = -1;
+
+        for (unsigned i = 0; i < stage.span; ++i) {
+            for (unsigned j = 1; j < stage.radix; ++j)
+                m_twiddles.append(root<C>(m_dir, (unsigned long long)i * j * stride, m_size));
+        }
+
+        if (stage.radix > 5) {
+            stage.rootOffset = m_twiddles.size();
+            for (unsigned r = 0; r < stage.radix; ++r)
+                m_twiddles.append(root<C>(m_dir, r, stage.radix));
+        }
+
+        m_stages.append(stage);
+        span = stage.span;
+        stride *= stage.radix;
+    }
+}
+
+template <typename C>
+void MixedFFTPlan<C>::initBluestein()
+{
+    const unsigned n = m_size;
+    const unsigned convSize = qNextPowerOfTwo(2 * n - 2);
+
+    m_convForward = plan(convSize, false);
+    m_convInverse = plan(convSize, true);
+
+    // w_k = exp(dir * i * pi * k^2 / n), with k^2 reduced modulo 2n
+    m_chirp = QVector<C>(n);
+    for (unsigned k = 0; k < n; ++k)
+        m_chirp[k] = root<C>(m_dir, (unsigned long long)k * k, 2ULL * n);
+
+    QVector<C> kernel(convSize);
+    kernel[0] = C(m_chirp[0].real, -m_chirp[0].imag);
+    for (unsigned k = 1; k < n; ++k) {
+        kernel[k] = C(m_chirp[k].real, -m_chirp[k].imag);
+        kernel[convSize - k] = kernel[k];
+    }
+
+    QVector<C> scratch(convSize);
+    C *spectrum = m_convForward->execute(kernel.data(), scratch.data(), 1);
+
+    // The inverse convolution transform is left unnormalized; fold 1 / size in here
+    const Scalar norm = 1.0 / convSize;
+    m_chirpSpectrum = QVector<C>(convSize);
+    for (unsigned k = 0; k < convSize; ++k)
+        m_chirpSpectrum[k] = scale(spectrum[k], norm);
+}
+
+template <typename C>
+unsigned MixedFFTPlan<C>::size() const
+{
+    return m_size;
+}
+
+template <typename C>
+unsigned MixedFFTPlan<C>::bufferSize() const
+{
+    return isBluestein() ? m_convForward->size() : m_size;
+}
+
+template <typename C>
+bool MixedFFTPlan<C>::isInverse() const
+{
+    return m_inverse;
+}
+
+template <typename C>
+bool MixedFFTPlan<C>::isBluestein() const
+{
+    return !m_convForward.isNull();
+}
+
+template <typename C>
+C *MixedFFTPlan<C>::execute(C *data, C *scratch, unsigned batch) const
+{
+    if (isBluestein())
+        return executeBluestein(data, scratch, batch);
+
+    return executeStockham(data, scratch, batch);
+}
+
+template <typename C>
+C *MixedFFTPlan<C>::executeStockham(C *data, C *scratch, unsigned batch) const
+{
+    C *x = data;
+    C *y = scratch;
+
+    for (int s = 0; s < m_stages.size(); ++s) {
+        const Stage &stage = m_stages[s];
+
+        switch (stage.radix) {
+        case 2:
+            radix2(stage, x, y, batch);
+            break;
+        case 3:
+            radix3(stage, x, y, batch);
+            break;
+        case 4:
+            radix4(stage, x, y, batch);
+            break;
+        case 5:
+            radix5(stage, x, y, batch);
+            break;
+        default:
+            radixGeneric(stage, x, y, batch);
+        }
+
+        C *tmp = x;
+        x = y;
+        y = tmp;
+    }
+
+    return x;
+}
+
+template <typename C>
+C *MixedFFTPlan<C>::executeBluestein(C *data, C *scratch, unsigned batch) const
+{
+    const unsigned n = m_size;
+    const unsigned convSize = m_convForward->size();
+
+    for (unsigned k = 0; k < n; ++k) {
+        const C w = m_chirp[k];
+        C *row = data + k * batch;
+        for (unsigned q = 0; q < batch; ++q)
+            row[q] = mul(row[q], w);
+    }
+    for (unsigned i = n * batch; i < convSize * batch; ++i)
+        data[i] = C();
+
+    C *spectrum = m_convForward->execute(data, scratch, batch);
+    C *other = spectrum == data ? scratch : data;
+
+    for (unsigned k = 0; k < convSize; ++k) {
+        const C b = m_chirpSpectrum[k];
+        C *row = spectrum + k * batch;
+        for (unsigned q = 0; q < batch; ++q)
+            row[q] = mul(row[q], b);
+    }
+
+    C *result = m_convInverse->execute(spectrum, other, batch);
+
+    for (unsigned k = 0; k < n; ++k) {
+        const C w = m_chirp[k];
+        C *row = result + k * batch;
+        for (unsigned q = 0; q < batch; ++q)
+            row[q] = mul(row[q], w);
+    }
+
+    return result;
+}
+
+// Each stage is one self-sorting (Stockham) decimation-in-frequency pass:
+// for every i < span the radix-point DFT of x[q + s * (i + t * span)] is
+// twiddled and stored to y[q + s * (radix * i + j)], so the output ends up
+// in natural order without any bit reversal.
+
+template <typename C>
+void MixedFFTPlan<C>::radix2(const Stage &stage, const C *x, C *y, unsigned batch) const
+{
+    const unsigned m = stage.span;
+    const unsigned s = stage.stride * batch;
+    const C *tw = m_twiddles.constData() + stage.twiddleOffset;
+
+    for (unsigned i = 0; i < m; ++i) {
+        const C w1 = tw[i];
+        for (unsigned q = 0; q < s; ++q) {
+            const C a0 = x[q + s * i];
+            const C a1 = x[q + s * (i + m)];
+
+            y[q + s * (2 * i)] = add(a0, a1);
+            y[q + s * (2 * i + 1)] = mul(sub(a0, a1), w1);
+        }
+    }
+}
+
+template <typename C>
+void MixedFFTPlan<C>::radix3(const Stage &stage, const C *x, C *y, unsigned batch) const
+{
+    const unsigned m = stage.span;
+    const unsigned s = stage.stride * batch;
+    const C *tw = m_twiddles.constData() + stage.twiddleOffset;
+    const Scalar sin60 = m_dir * 0.86602540378443864676;
+
+    for (unsigned i = 0; i < m; ++i) {
+        const C w1 = tw[2 * i];
+        const C w2 = tw[2 * i + 1];
+        for (unsigned q = 0; q < s; ++q) {
+            const C a0 = x[q + s * i];
+            const C a1 = x[q + s * (i + m)];
+            const C a2 = x[q + s * (i + 2 * m)];
+
+            const C t1 = add(a1, a2);
+            const C t2 = sub(a0, scale(t1, 0.5));
+            const C t3 = mulImag(sub(a1, a2), sin60);
+
+            y[q + s * (3 * i)] = add(a0, t1);
+            y[q + s * (3 * i + 1)] = mul(add(t2, t3), w1);
+            y[q + s * (3 * i + 2)] = mul(sub(t2, t3), w2);
+        }
+    }
+}
+
+template <typename C>
+void MixedFFTPlan<C>::radix4(const Stage &stage, const C *x, C *y, unsigned batch) const
+{
+    const unsigned m = stage.span;
+    const unsigned s = stage.stride * batch;
+    const C *tw = m_twiddles.constData() + stage.twiddleOffset;
+
+    for (unsigned i = 0; i < m; ++i) {
+        const C w1 = tw[3 * i];
+        const C w2 = tw[3 * i + 1];
+        const C w3 = tw[3 * i + 2];
+        for (unsigned q = 0; q < s; ++q) {
+            const C a0 = x[q + s * i];
+            const C a1 = x[q + s * (i + m)];
+            const C a2 = x[q + s * (i + 2 * m)];
+            const C a3 = x[q + s * (i + 3 * m)];
+
+            const C b0 = add(a0, a2);
+            const C b1 = sub(a0, a2);
+            const C b2 = add(a1, a3);
+            const C b3 = mulImag(sub(a1, a3), m_dir);
+
+            y[q + s * (4 * i)] = add(b0, b2);
+            y[q + s * (4 * i + 1)] = mul(add(b1, b3), w1);
+            y[q + s * (4 * i + 2)] = mul(sub(b0, b2), w2);
+            y[q + s * (4 * i + 3)] = mul(sub(b1, b3), w3);
+        }
+    }
+}
+
+template <typename C>
+void MixedFFTPlan<C>::radix5(const Stage &stage, const C *x, C *y, unsigned batch) const
+{
+    const unsigned m = stage.span;
+    const unsigned s = stage.stride * batch;
+    const C *tw = m_twiddles.constData() + stage.twiddleOffset;
+    const Scalar cos72 = 0.30901699437494742410;
+    const Scalar cos144 = -0.80901699437494742410;
+    const Scalar sin72 = m_dir * 0.95105651629515357212;
+    const Scalar sin144 = m_dir * 0.58778525229247312917;
+
+    for (unsigned i = 0; i < m; ++i) {
+        const C *w = tw + 4 * i;
+        for (unsigned q = 0; q < s; ++q) {
+            const C a0 = x[q + s * i];
+            const C a1 = x[q + s * (i + m)];
+            const C a2 = x[q + s * (i + 2 * m)];
+            const C a3 = x[q + s * (i + 3 * m)];
+            const C a4 = x[q + s * (i + 4 * m)];
+
+            const C s14 = add(a1, a4);
+            const C d14 = sub(a1, a4);
+            const C s23 = add(a2, a3);
+            const C d23 = sub(a2, a3);
+
+            const C r1 = add(a0, add(scale(s14, cos72), scale(s23, cos144)));
+            const C r2 = add(a0, add(scale(s14, cos144), scale(s23, cos72)));
+            const C i1 = mulImag(add(scale(d14, sin72), scale(d23, sin144)), 1.0);
+            const C i2 = mulImag(sub(scale(d14, sin144), scale(d23, sin72)), 1.0);
+
+            y[q + s * (5 * i)] = add(a0, add(s14, s23));
+            y[q + s * (5 * i + 1)] = mul(add(r1, i1), w[0]);
+            y[q + s * (5 * i + 2)] = mul(add(r2, i2), w[1]);
+            y[q + s * (5 * i + 3)] = mul(sub(r2, i2), w[2]);
+            y[q + s * (5 * i + 4)] = mul(sub(r1, i1), w[3]);
+        }
+    }
+}
+
+template <typename C>
+void MixedFFTPlan<C>::radixGeneric(const Stage &stage, const C *x, C *y, unsigned batch) const
+{
+    const unsigned p = stage.radix;
+    const unsigned m = stage.span;
+    const unsigned s = stage.stride * batch;
+    const C *tw = m_twiddles.constData() + stage.twiddleOffset;
+    const C *roots = m_twiddles.constData() + stage.rootOffset;
+
+    C a[kMaxRadix];
+
+    for (unsigned i = 0; i < m; ++i) {
+        const C *w = tw + (p - 1) * i;
+        for (unsigned q = 0; q < s; ++q) {
+            for (unsigned t = 0; t < p; ++t)
+                a[t] = x[q + s * (i + t * m)];
+
+            C sum = a[0];
+            for (unsigned t = 1; t < p; ++t)
+                sum = add(sum, a[t]);
+            y[q + s * (p * i)] = sum;
+
+            for (unsigned j = 1; j < p; ++j) {
+                sum = a[0];
+                unsigned r = 0;
+                for (unsigned t = 1; t < p; ++t) {
+                    r += j;
+                    if (r >= p)
+                        r -= p;
+                    sum = add(sum, mul(a[t], roots[r]));
+                }
+                y[q + s * (p * i + j)] = mul(sum, w[j - 1]);
+            }
+        }
+    }
+}
+
+template class MixedFFTPlan<Complex>;
+template class MixedFFTPlan<ComplexDouble>;
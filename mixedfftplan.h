@@ -0,0 +1,65 @@
+#ifndef MIXEDFFTPLAN_H
+#define MIXEDFFTPLAN_H
+
+#include <QSharedPointer>
+#include <QVector>
+
+#include "ft.h"
+
+// C is the element type, Complex or ComplexDouble; both are instantiated in
+// mixedfftplan.cpp.
+template <typename C>
+class MixedFFTPlan {
+public:
+    typedef typename C::Scalar Scalar;
+
+    static QSharedPointer<const MixedFFTPlan> plan(unsigned n, bool inverse);
+
+    unsigned size() const;
+    unsigned bufferSize() const;
+    bool isInverse() const;
+    bool isBluestein() const;
+
+    // Transforms batch interleaved sequences: element i of sequence q is
+    // data[q + i * batch]. Both buffers must hold bufferSize() * batch
+    // elements. Returns the buffer holding the (unnormalized) result.
+    C *execute(C *data, C *scratch, unsigned batch) const;
+
+private:
+    struct Stage {
+        unsigned radix;
+        unsigned span;
+        unsigned stride;
+        int twiddleOffset;
+        int rootOffset;
+    };
+
+    MixedFFTPlan(unsigned n, bool inverse);
+    Q_DISABLE_COPY(MixedFFTPlan)
+
+    void initStages(QVector<unsigned> factors);
+    void initBluestein();
+
+    void radix2(const Stage &, const C *, C *, unsigned) const;
+    void radix3(const Stage &, const C *, C *, unsigned) const;
+    void radix4(const Stage &, const C *, C *, unsigned) const;
+    void radix5(const Stage &, const C *, C *, unsigned) const;
+    void radixGeneric(const Stage &, const C *, C *, unsigned) const;
+
+    C *executeStockham(C *, C *, unsigned) const;
+    C *executeBluestein(C *, C *, unsigned) const;
+
+    unsigned m_size;
+    bool m_inverse;
+    Scalar m_dir;
+
+    QVector<Stage> m_stages;
+    QVector<C> m_twiddles;
+
+    QSharedPointer<const MixedFFTPlan> m_convForward;
+    QSharedPointer<const MixedFFTPlan> m_convInverse;
+    QVector<C> m_chirp;
+    QVector<C> m_chirpSpectrum;
+};
+
+#endif // MIXEDFFTPLAN_H
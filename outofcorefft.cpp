@@ -0,0 +1,248 @@
+#include "outofcorefft.h"
+
+#include <string.h>
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QSharedPointer>
+#include <QTemporaryFile>
+#include <QVector>
+
+#include "ft.h"
+#include "mixedfftplan.h"
+#include "parallel.h"
+
+// Rows or columns transformed together as interleaved sequences
+static const int kBlock = 16;
+
+static const qint64 kDefaultMemoryBudget = 512 << 20;
+
+OutOfCoreFFT::OutOfCoreFFT(int cols, int rows)
+    : m_cols(cols)
+    , m_rows(rows)
+    , m_memoryBudget(kDefaultMemoryBudget)
+    , m_threadCount(Parallel::idealThreadCount())
+    , m_elapsed(0)
+{
+}
+
+qint64 OutOfCoreFFT::memoryBudget() const
+{
+    return m_memoryBudget;
+}
+
+void OutOfCoreFFT::setMemoryBudget(qint64 bytes)
+{
+    m_memoryBudget = bytes;
+}
+
+int OutOfCoreFFT::threadCount() const
+{
+    return m_threadCount;
+}
+
+void OutOfCoreFFT::setThreadCount(int threads)
+{
+    m_threadCount = qMax(1, threads);
+}
+
+int OutOfCoreFFT::elapsed() const
+{
+    return m_elapsed;
+}
+
+double OutOfCoreFFT::bytesPerSecond() const
+{
+    const double pixels = (double)m_rows * m_cols;
+    const double traffic = pixels * (1 + 3 * sizeof(Complex));
+
+    return m_elapsed > 0 ? traffic * 1000.0 / m_elapsed : 0.0;
+}
+
+// A row block holds its gray values, its transposed spectrum rows and
+// the scratch pages they are copied into
+int OutOfCoreFFT::rowBlock() const
+{
+    const qint64 perRow = (qint64)m_cols * (1 + 2 * sizeof(Complex));
+    return qBound<qint64>(1, m_memoryBudget / perRow, m_rows);
+}
+
+// A column block holds its columns gathered from the scratch strips, the
+// transformed block in row order and the output pages it is copied into
+int OutOfCoreFFT::columnBlock() const
+{
+    const qint64 perColumn = (qint64)m_rows * 3 * sizeof(Complex);
+    return qBound<qint64>(1, m_memoryBudget / perColumn, m_cols);
+}
+
+bool OutOfCoreFFT::transform(const QString &inputPath, const QString &outputPath, const QString &scratchPath)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    const qint64 pixels = (qint64)m_rows * m_cols;
+    const qint64 bytes = pixels * sizeof(Complex);
+
+    QFile input(inputPath);
+    if (!input.open(QIODevice::ReadOnly)) {
+        qWarning("Unable to open %s: %s", qPrintable(inputPath), qPrintable(input.errorString()));
+        return false;
+    }
+    if (input.size() < pixels) {
+        qWarning("%s holds less than %dx%d pixels", qPrintable(inputPath), m_cols, m_rows);
+        return false;
+    }
+
+    QFile output(outputPath);
+    if (!output.open(QIODevice::ReadWrite | QIODevice::Truncate) || !output.resize(bytes)) {
+        qWarning("Unable to create %s: %s", qPrintable(outputPath), qPrintable(output.errorString()));
+        return false;
+    }
+
+    QTemporaryFile temporary(outputPath + QStringLiteral(".XXXXXX"));
+    QFile named(scratchPath);
+    QFile &scratch = scratchPath.isEmpty() ? static_cast<QFile &>(temporary) : named;
+    const bool opened = scratchPath.isEmpty() ? temporary.open()
+                                              : named.open(QIODevice::ReadWrite | QIODevice::Truncate);
+    if (!opened || !scratch.resize(bytes)) {
+        qWarning("Unable to create scratch file %s: %s", qPrintable(scratch.fileName()),
+                 qPrintable(scratch.errorString()));
+        return false;
+    }
+
+    QSharedPointer<const MixedFFTPlan<Complex> > rowPlan = MixedFFTPlan<Complex>::plan(m_cols, false);
+    QSharedPointer<const MixedFFTPlan<Complex> > colPlan = MixedFFTPlan<Complex>::plan(m_rows, false);
+    const int bufferSize = qMax(rowPlan->bufferSize(), colPlan->bufferSize()) * kBlock;
+
+    QVector<QVector<Complex> > workers(m_threadCount);
+    for (int i = 0; i < m_threadCount; ++i)
+        workers[i].resize(2 * bufferSize);
+
+    bool ok = true;
+
+    // Row pass: each block of rows becomes one strip of the scratch file,
+    // stored column after column, so a block of columns is one contiguous
+    // range of every strip
+    const int blockRows = rowBlock();
+    QVector<uchar> gray(blockRows * m_cols);
+    QVector<Complex> transposed(blockRows * m_cols);
+
+    for (int r0 = 0; ok && r0 < m_rows; r0 += blockRows) {
+        const int block = qMin(blockRows, m_rows - r0);
+        if (input.read(reinterpret_cast<char *>(gray.data()), (qint64)block * m_cols) != (qint64)block * m_cols) {
+            qWarning("Unable to read %s: %s", qPrintable(inputPath), qPrintable(input.errorString()));
+            ok = false;
+            break;
+        }
+
+        Parallel::forRangeIndexed((block + kBlock - 1) / kBlock, 1, m_threadCount, [&](int worker, int begin, int end) {
+            Complex *work = workers[worker].data();
+            Complex *tmp = work + bufferSize;
+
+            for (int b = begin; b < end; ++b) {
+                const int y0 = b * kBlock;
+                const int n = qMin(kBlock, block - y0);
+
+                for (int y = 0; y < n; ++y) {
+                    const uchar *row = &gray[(y0 + y) * m_cols];
+                    for (int x = 0; x < m_cols; ++x)
+                        work[y + x * n] = Complex(row[x], 0.0);
+                }
+
+                const Complex *rows = rowPlan->execute(work, tmp, n);
+                for (int x = 0; x < m_cols; ++x)
+                    memcpy(&transposed[x * block + y0], &rows[x * n], n * sizeof(Complex));
+            }
+        });
+
+        const qint64 stripSize = (qint64)block * m_cols * sizeof(Complex);
+        uchar *strip = scratch.map((qint64)r0 * m_cols * sizeof(Complex), stripSize);
+        if (!strip) {
+            qWarning("Unable to map scratch file: %s", qPrintable(scratch.errorString()));
+            ok = false;
+            break;
+        }
+
+        memcpy(strip, transposed.constData(), stripSize);
+        scratch.unmap(strip);
+    }
+
+    gray = QVector<uchar>();
+    transposed = QVector<Complex>();
+
+    // Column pass over blocks of whole columns, gathered from every strip
+    // and written back into the output one strip of rows at a time
+    const int blockCols = columnBlock();
+    QVector<Complex> columns(ok ? blockCols * m_rows : 0);
+    QVector<Complex> rowOrder(ok ? blockCols * m_rows : 0);
+
+    for (int c0 = 0; ok && c0 < m_cols; c0 += blockCols) {
+        const int block = qMin(blockCols, m_cols - c0);
+
+        for (int r0 = 0; ok && r0 < m_rows; r0 += blockRows) {
+            const int height = qMin(blockRows, m_rows - r0);
+            const qint64 offset = ((qint64)r0 * m_cols + (qint64)c0 * height) * sizeof(Complex);
+
+            const Complex *strip = reinterpret_cast<const Complex *>(
+                scratch.map(offset, (qint64)block * height * sizeof(Complex)));
+            if (!strip) {
+                qWarning("Unable to map scratch file: %s", qPrintable(scratch.errorString()));
+                ok = false;
+                break;
+            }
+
+            for (int x = 0; x < block; ++x)
+                memcpy(&columns[x * m_rows + r0], strip + x * height, height * sizeof(Complex));
+            scratch.unmap(reinterpret_cast<uchar *>(const_cast<Complex *>(strip)));
+        }
+        if (!ok)
+            break;
+
+        Parallel::forRangeIndexed((block + kBlock - 1) / kBlock, 1, m_threadCount, [&](int worker, int begin, int end) {
+            Complex *work = workers[worker].data();
+            Complex *tmp = work + bufferSize;
+
+            for (int b = begin; b < end; ++b) {
+                const int x0 = b * kBlock;
+                const int n = qMin(kBlock, block - x0);
+
+                for (int x = 0; x < n; ++x) {
+                    const Complex *column = &columns[(x0 + x) * m_rows];
+                    for (int y = 0; y < m_rows; ++y)
+                        work[x + y * n] = column[y];
+                }
+
+                const Complex *result = colPlan->execute(work, tmp, n);
+                for (int y = 0; y < m_rows; ++y)
+                    memcpy(&rowOrder[y * block + x0], &result[y * n], n * sizeof(Complex));
+            }
+        });
+
+        // From the first row's columns to the last row's, within the strip
+        for (int r0 = 0; ok && r0 < m_rows; r0 += blockRows) {
+            const int height = qMin(blockRows, m_rows - r0);
+            const qint64 offset = ((qint64)r0 * m_cols + c0) * sizeof(Complex);
+            const qint64 size = ((qint64)(height - 1) * m_cols + block) * sizeof(Complex);
+
+            Complex *mapped = reinterpret_cast<Complex *>(output.map(offset, size));
+            if (!mapped) {
+                qWarning("Unable to map %s: %s", qPrintable(outputPath), qPrintable(output.errorString()));
+                ok = false;
+                break;
+            }
+
+            Parallel::forRange(height, kBlock, m_threadCount, [&](int begin, int end) {
+                for (int y = begin; y < end; ++y)
+                    memcpy(mapped + (qint64)y * m_cols, &rowOrder[(r0 + y) * block], block * sizeof(Complex));
+            });
+            output.unmap(reinterpret_cast<uchar *>(mapped));
+        }
+    }
+
+    if (!scratchPath.isEmpty())
+        named.remove();
+
+    m_elapsed = timer.elapsed();
+
+    return ok;
+}
@@ -0,0 +1,51 @@
+#ifndef OUTOFCOREFFT_H
+#define OUTOFCOREFFT_H
+
+#include <QString>
+
+// 2D FFT of images too large for memory, e.g. gigapixel scans. The input
+// is a raw file of rows x cols 8-bit gray values stored row after row; the
+// spectrum is written as rows x cols Complex values in the same order.
+//
+// The row pass streams blocks of rows from the input and writes each block
+// transposed as one strip of a memory-mapped scratch file, so that a block
+// of columns is a contiguous range of every strip. The column pass gathers
+// its columns strip by strip and writes its results back into the output
+// rows of one strip at a time. Only the range a block touches is mapped
+// and mappings only live for one block, which keeps the resident memory
+// and the address space near memoryBudget(). Any size is supported,
+// through the mixed-radix plans.
+class OutOfCoreFFT {
+public:
+    OutOfCoreFFT(int cols, int rows);
+
+    // Bytes of buffers and mapped pages one block may use; blocks shrink
+    // to match, but never below one row or column
+    qint64 memoryBudget() const;
+    void setMemoryBudget(qint64 bytes);
+
+    int threadCount() const;
+    void setThreadCount(int);
+
+    // The scratch file is a temporary next to output unless scratchPath is
+    // given; either way it is removed afterwards
+    bool transform(const QString &inputPath, const QString &outputPath,
+                   const QString &scratchPath = QString());
+
+    // Milliseconds of the last transform, and its file traffic (input,
+    // scratch written and read back, output) per second
+    int elapsed() const;
+    double bytesPerSecond() const;
+
+private:
+    int rowBlock() const;
+    int columnBlock() const;
+
+    int m_cols;
+    int m_rows;
+    qint64 m_memoryBudget;
+    int m_threadCount;
+    int m_elapsed;
+};
+
+#endif // OUTOFCOREFFT_H
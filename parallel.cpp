@@ -0,0 +1,92 @@
+#include "parallel.h"
+
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThread>
+#include <QThreadPool>
+
+// One runnable on the caller's stack is started once per helper thread; each
+// run takes the next worker index. Not auto-deleted, so dispatching a range
+// does not allocate.
+class RangeWorker : public QRunnable {
+public:
+    RangeWorker(int count, int grain, Parallel::RangeFunction function, const void *body)
+        : m_worker(0)
+        , m_next(0)
+        , m_count(count)
+        , m_grain(grain)
+        , m_function(function)
+        , m_body(body)
+    {
+        setAutoDelete(false);
+    }
+
+    void run()
+    {
+        work(m_worker.fetchAndAddRelaxed(1) + 1);
+        m_done.release();
+    }
+
+    void work(int worker)
+    {
+        for (;;) {
+            const int begin = m_next.fetchAndAddRelaxed(m_grain);
+            if (begin >= m_count)
+                return;
+
+            m_function(m_body, worker, begin, qMin(begin + m_grain, m_count));
+        }
+    }
+
+    void wait(int helpers)
+    {
+        m_done.acquire(helpers);
+    }
+
+private:
+    QAtomicInt m_worker;
+    QAtomicInt m_next;
+    int m_count;
+    int m_grain;
+    Parallel::RangeFunction m_function;
+    const void *m_body;
+    QSemaphore m_done;
+};
+
+static QThreadPool *workerPool()
+{
+    static QThreadPool pool;
+    return &pool;
+}
+
+int Parallel::idealThreadCount()
+{
+    return qMax(1, QThread::idealThreadCount());
+}
+
+void Parallel::run(int count, int grain, int threads, RangeFunction function, const void *body)
+{
+    if (count <= 0)
+        return;
+
+    grain = qMax(1, grain);
+    const int ranges = (count + grain - 1) / grain;
+    const int helpers = qMin(threads, ranges) - 1;
+
+    if (helpers <= 0) {
+        function(body, 0, 0, count);
+        return;
+    }
+
+    QThreadPool *pool = workerPool();
+    if (pool->maxThreadCount() < helpers)
+        pool->setMaxThreadCount(helpers);
+
+    RangeWorker task(count, grain, function, body);
+    for (int i = 0; i < helpers; ++i)
+        pool->start(&task);
+
+    task.work(0);
+    task.wait(helpers);
+}
@@ -0,0 +1,46 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+class Parallel {
+public:
+    static int idealThreadCount();
+
+    // Splits [0, count) into ranges of grain items and runs body(begin, end)
+    // on them from up to threads threads, the calling one included. Ranges
+    // are handed out on demand, so uneven work balances itself. Returns when
+    // every range is done.
+    template <typename Body>
+    static void forRange(int count, int grain, int threads, const Body &body);
+
+    // Same as forRange(), but body(worker, begin, end) also gets the index
+    // of the thread running it: 0 for the calling thread, below threads for
+    // the others. Lets callers keep scratch memory per thread across calls.
+    template <typename Body>
+    static void forRangeIndexed(int count, int grain, int threads, const Body &body);
+
+private:
+    friend class RangeWorker;
+
+    // The body is passed by address with a matching trampoline rather than
+    // as a std::function, which would allocate for larger lambdas.
+    typedef void (*RangeFunction)(const void *body, int worker, int begin, int end);
+    static void run(int count, int grain, int threads, RangeFunction function, const void *body);
+};
+
+template <typename Body>
+void Parallel::forRange(int count, int grain, int threads, const Body &body)
+{
+    run(count, grain, threads, [](const void *b, int, int begin, int end) {
+        (*static_cast<const Body *>(b))(begin, end);
+    }, &body);
+}
+
+template <typename Body>
+void Parallel::forRangeIndexed(int count, int grain, int threads, const Body &body)
+{
+    run(count, grain, threads, [](const void *b, int worker, int begin, int end) {
+        (*static_cast<const Body *>(b))(worker, begin, end);
+    }, &body);
+}
+
+#endif // PARALLEL_H
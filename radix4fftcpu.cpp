@@ -0,0 +1,26 @@
+#include "radix4fftcpu.h"
+
+#include "fftkernels.h"
+#include "fftplan.h"
+
+Radix4FFTCpu::Radix4FFTCpu(FImage *image, QObject *parent)
+    : FFTCpu(image, parent)
+{
+}
+
+Radix4FFTCpu::~Radix4FFTCpu()
+{
+}
+
+QString Radix4FFTCpu::variant() const
+{
+    return QStringLiteral("scalar radix-4 butterflies");
+}
+
+void Radix4FFTCpu::fft1D(float *real, float *imag, float *work, const FFTPlan &plan) const
+{
+    Q_UNUSED(work);
+
+    revbinPermute(real, imag, plan);
+    FFTKernels::radix4Butterflies(real, imag, plan);
+}
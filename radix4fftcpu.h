@@ -0,0 +1,17 @@
+#ifndef RADIX4FFTCPU_H
+#define RADIX4FFTCPU_H
+
+#include "fftcpu.h"
+
+class Radix4FFTCpu : public FFTCpu {
+public:
+    explicit Radix4FFTCpu(FImage *image, QObject *parent = 0);
+    ~Radix4FFTCpu();
+
+    QString variant() const;
+
+protected:
+    void fft1D(float *, float *, float *, const FFTPlan &) const;
+};
+
+#endif // RADIX4FFTCPU_H
@@ -0,0 +1,225 @@
+#include "registration.h"
+
+#include <QtMath>
+
+#include "fimage.h"
+#include "parallel.h"
+
+// Rows handed to a thread at a time
+static const int kRowGrain = 16;
+
+// Offset of a peak from the sample c0 between its neighbours cm and cp, from
+// the parabola through all three
+static double peakOffset(double cm, double c0, double cp)
+{
+    const double denominator = cm - 2.0 * c0 + cp;
+    return denominator < 0.0 ? 0.5 * (cm - cp) / denominator : 0.0;
+}
+
+Registration::Registration(FT::FTType type)
+    : m_type(type)
+    , m_windowed(true)
+    , m_filter(SpectrumFilter::lowPass(0.3f, 2))
+    , m_threadCount(Parallel::idealThreadCount())
+    , m_cols(0)
+    , m_rows(0)
+    , m_spectrumCols(0)
+    , m_filterGain(1.0)
+{
+}
+
+Registration::~Registration()
+{
+}
+
+bool Registration::windowed() const
+{
+    return m_windowed;
+}
+
+void Registration::setWindowed(bool windowed)
+{
+    m_windowed = windowed;
+}
+
+SpectrumFilter Registration::filter() const
+{
+    return m_filter;
+}
+
+void Registration::setFilter(const SpectrumFilter &filter)
+{
+    m_filter = filter;
+    if (m_ft)
+        updateFilterGain();
+}
+
+int Registration::threadCount() const
+{
+    return m_threadCount;
+}
+
+void Registration::setThreadCount(int threads)
+{
+    m_threadCount = qMax(1, threads);
+    if (m_ft)
+        m_ft->setThreadCount(m_threadCount);
+}
+
+bool Registration::setReference(const FImage &reference)
+{
+    const int cols = reference.width();
+    const int rows = reference.height();
+
+    if (!m_ft || cols != m_cols || rows != m_rows) {
+        m_ft.reset(FT::createFT(m_type, const_cast<FImage *>(&reference)));
+        if (!m_ft) {
+            qWarning("[ERROR] Unknown FT type %d", m_type);
+            return false;
+        }
+        m_ft->setThreadCount(m_threadCount);
+
+        m_cols = cols;
+        m_rows = rows;
+        m_spectrumCols = m_ft->spectrumLayout() == FT::HalfSpectrum ? cols / 2 + 1 : cols;
+
+        m_windowX.resize(cols);
+        for (int x = 0; x < cols; ++x)
+            m_windowX[x] = 0.5 - 0.5 * cos(2.0 * M_PI * x / cols);
+        m_windowY.resize(rows);
+        for (int y = 0; y < rows; ++y)
+            m_windowY[y] = 0.5 - 0.5 * cos(2.0 * M_PI * y / rows);
+
+        m_frequencies.resize(m_spectrumCols);
+        for (int c = 0; c < m_spectrumCols; ++c)
+            m_frequencies[c] = (c <= cols / 2 ? c : c - cols) / (0.5f * cols);
+
+        updateFilterGain();
+
+        m_values.resize(cols * rows);
+        m_spectrum.resize(rows * m_spectrumCols);
+        m_reference.resize(rows * m_spectrumCols);
+    }
+
+    windowedValues(reference, m_values.data());
+    m_ft->transformReal(m_values.constData(), m_reference.data());
+
+    return true;
+}
+
+Registration::Shift Registration::align(const FImage &target)
+{
+    Shift shift = { 0.0, 0.0, 0.0 };
+    if (!m_ft || target.width() != m_cols || target.height() != m_rows) {
+        qWarning("Target is not the %dx%d of the reference", m_cols, m_rows);
+        return shift;
+    }
+
+    windowedValues(target, m_values.data());
+    m_ft->transformReal(m_values.constData(), m_spectrum.data());
+
+    Complex *spectrum = m_spectrum.data();
+    const Complex *reference = m_reference.constData();
+    Parallel::forRange(m_rows, kRowGrain, m_threadCount, [&](int begin, int end) {
+        for (int r = begin; r < end; ++r) {
+            Complex *row = spectrum + r * m_spectrumCols;
+            const Complex *referenceRow = reference + r * m_spectrumCols;
+            for (int c = 0; c < m_spectrumCols; ++c) {
+                const Complex g = row[c];
+                const Complex f = referenceRow[c];
+                const float real = g.real * f.real + g.imag * f.imag;
+                const float imag = g.imag * f.real - g.real * f.imag;
+                const float norm = sqrtf(real * real + imag * imag);
+                const float scale = norm > 0.0f ? 1.0f / norm : 0.0f;
+                row[c] = Complex(real * scale, imag * scale);
+            }
+
+            const float v = (r <= m_rows / 2 ? r : r - m_rows) / (0.5f * m_rows);
+            m_filter.apply(row, row, m_frequencies.constData(), v, m_spectrumCols);
+        }
+    });
+
+    float *correlation = m_values.data();
+    m_ft->inverseTransformReal(spectrum, correlation);
+
+    // Highest value of each worker's rows, then of all workers
+    QVector<int> best(m_threadCount, 0);
+    Parallel::forRangeIndexed(m_rows, kRowGrain, m_threadCount, [&](int worker, int begin, int end) {
+        int index = best[worker];
+        for (int i = begin * m_cols; i < end * m_cols; ++i) {
+            if (correlation[i] > correlation[index])
+                index = i;
+        }
+        best[worker] = index;
+    });
+
+    int peak = best[0];
+    for (int w = 1; w < m_threadCount; ++w) {
+        if (correlation[best[w]] > correlation[peak])
+            peak = best[w];
+    }
+
+    const int x = peak % m_cols;
+    const int y = peak / m_cols;
+    const float *row = correlation + y * m_cols;
+    const double c0 = row[x];
+
+    shift.x = x + peakOffset(row[x ? x - 1 : m_cols - 1], c0, row[x + 1 < m_cols ? x + 1 : 0]);
+    shift.y = y + peakOffset(correlation[(y ? y - 1 : m_rows - 1) * m_cols + x], c0,
+                             correlation[(y + 1 < m_rows ? y + 1 : 0) * m_cols + x]);
+    if (shift.x > m_cols / 2)
+        shift.x -= m_cols;
+    if (shift.y > m_rows / 2)
+        shift.y -= m_rows;
+    shift.peak = c0 / m_filterGain;
+
+    return shift;
+}
+
+// Mean of the filter over the whole spectrum, which is how high it leaves
+// the peak of identical frames
+void Registration::updateFilterGain()
+{
+    QVector<float> u(m_cols);
+    for (int c = 0; c < m_cols; ++c)
+        u[c] = (c <= m_cols / 2 ? c : c - m_cols) / (0.5f * m_cols);
+    const QVector<Complex> ones(m_cols, Complex(1.0f, 0.0f));
+    QVector<Complex> row(m_cols);
+
+    double sum = 0.0;
+    for (int r = 0; r < m_rows; ++r) {
+        const float v = (r <= m_rows / 2 ? r : r - m_rows) / (0.5f * m_rows);
+        m_filter.apply(ones.constData(), row.data(), u.constData(), v, m_cols);
+        for (int c = 0; c < m_cols; ++c)
+            sum += row[c].real;
+    }
+    m_filterGain = qMax(sum / ((double)m_cols * m_rows), 1e-12);
+}
+
+// Gray values less their mean, so that the window does not add a pattern
+// of its own that stays put while the content moves, tapered by the window
+void Registration::windowedValues(const FImage &image, float *values) const
+{
+    const QVector<uchar> data = image.data();
+    const uchar *gray = data.constData();
+
+    double sum = 0.0;
+    for (int i = 0; i < data.size(); ++i)
+        sum += gray[i];
+    const float mean = sum / data.size();
+
+    Parallel::forRange(m_rows, kRowGrain, m_threadCount, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const uchar *in = gray + y * m_cols;
+            float *out = values + y * m_cols;
+            if (m_windowed) {
+                const float wy = m_windowY[y];
+                for (int x = 0; x < m_cols; ++x)
+                    out[x] = (in[x] - mean) * m_windowX[x] * wy;
+            } else {
+                for (int x = 0; x < m_cols; ++x)
+                    out[x] = in[x] - mean;
+            }
+        }
+    });
+}
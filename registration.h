@@ -0,0 +1,81 @@
+#ifndef REGISTRATION_H
+#define REGISTRATION_H
+
+#include <QScopedPointer>
+#include <QVector>
+
+#include "ft.h"
+#include "spectrumfilter.h"
+
+// Translation between frames by phase correlation. The cross-power spectrum
+// G F* / |G F*| of target G and reference F keeps only the phase difference,
+// and its inverse transform, weighted by filter(), is a single peak at the
+// shift. The peak is refined to sub-pixel precision from its neighbours. The
+// reference's spectrum is computed once by setReference() and reused for
+// every target, so each alignment costs one real forward and one real
+// inverse transform.
+class Registration {
+public:
+    struct Shift {
+        // How far the target's content lies right of and below the
+        // reference's, wrapped to within half the frame size
+        double x;
+        double y;
+
+        // Height of the correlation peak, near 1 for frames that only
+        // differ by the shift and near 0 for unrelated ones
+        double peak;
+    };
+
+    explicit Registration(FT::FTType type = FT::REALFFTCPU);
+    ~Registration();
+
+    // Whether frames are tapered to their borders with a Hann window before
+    // the transform, which keeps the image edges, wrapped around by the
+    // transform, from pulling the peak towards no shift; on by default
+    bool windowed() const;
+    void setWindowed(bool);
+
+    // Weights the cross-power spectrum before the inverse transform.
+    // Whitening gives the noise at high frequencies as much weight as the
+    // content below them, so by default a low pass with a cutoff of 0.3
+    // keeps it from scattering the peak.
+    SpectrumFilter filter() const;
+    void setFilter(const SpectrumFilter &);
+
+    int threadCount() const;
+    void setThreadCount(int);
+
+    bool setReference(const FImage &reference);
+
+    // Target must have the size of the reference
+    Shift align(const FImage &target);
+
+private:
+    Q_DISABLE_COPY(Registration)
+
+    void updateFilterGain();
+    void windowedValues(const FImage &image, float *values) const;
+
+    FT::FTType m_type;
+    bool m_windowed;
+    SpectrumFilter m_filter;
+    int m_threadCount;
+
+    QScopedPointer<FT> m_ft;
+    int m_cols;
+    int m_rows;
+    int m_spectrumCols;
+    QVector<float> m_windowX;
+    QVector<float> m_windowY;
+    QVector<float> m_frequencies;
+    double m_filterGain;
+    QVector<Complex> m_reference;
+
+    // Reused by every alignment: the target's values, later the correlation,
+    // and the target's spectrum, later the cross-power spectrum
+    QVector<float> m_values;
+    QVector<Complex> m_spectrum;
+};
+
+#endif // REGISTRATION_H
@@ -0,0 +1,116 @@
+#include "separabledftcpu.h"
+
+#include "bufferpool.h"
+#include "dftmatrix.h"
+#include "parallel.h"
+
+SeparableDFTCpu::SeparableDFTCpu(FImage *image, QObject *parent)
+    : FT(image, parent)
+{
+}
+
+SeparableDFTCpu::~SeparableDFTCpu()
+{
+    for (int i = 0; i < m_scratch.size(); ++i)
+        m_pool->release(m_scratch[i].first);
+}
+
+Complex *SeparableDFTCpu::calculateFourier(Complex *input, bool inverse)
+{
+    Complex *fourier = new Complex[m_rows * m_cols];
+    calculateFourierInto(input, fourier, inverse);
+
+    return fourier;
+}
+
+// DFT matrices are symmetric, so both passes can add whole matrix rows
+// scaled by one input value into a row of accumulators. The inner loops
+// then run over contiguous memory without a reduction and vectorize. The
+// row pass leaves its result in split double planes; output is only
+// written by the column pass, so it may alias input.
+void SeparableDFTCpu::calculateFourierInto(const Complex *input, Complex *output, bool inverse)
+{
+    const int size = m_rows * m_cols;
+    const double norm = inverse ? 1.0 / size : 1.0;
+
+    QSharedPointer<const DFTMatrix> rowMatrix = DFTMatrix::matrix(m_cols, inverse);
+    QSharedPointer<const DFTMatrix> colMatrix = DFTMatrix::matrix(m_rows, inverse);
+    if (!rowMatrix || !colMatrix) {
+        memset(output, 0, size * sizeof(Complex));
+        return;
+    }
+
+    if (m_scratch.size() < m_threadCount)
+        m_scratch.resize(m_threadCount);
+
+    double *planeReal = m_pool->acquire<double>(size);
+    double *planeImag = m_pool->acquire<double>(size);
+
+    Parallel::forRange(m_rows, 1, m_threadCount, [&](int begin, int end) {
+        for (int y = begin; y < end; ++y) {
+            const Complex *row = &input[y * m_cols];
+            double *sumReal = &planeReal[y * m_cols];
+            double *sumImag = &planeImag[y * m_cols];
+
+            memset(sumReal, 0, m_cols * sizeof(double));
+            memset(sumImag, 0, m_cols * sizeof(double));
+
+            for (int x = 0; x < m_cols; ++x) {
+                const double fr = row[x].real;
+                const double fi = row[x].imag;
+                const float *c = rowMatrix->cosRow(x);
+                const float *s = rowMatrix->sinRow(x);
+
+                for (int u = 0; u < m_cols; ++u) {
+                    sumReal[u] += fr * c[u] - fi * s[u];
+                    sumImag[u] += fi * c[u] + fr * s[u];
+                }
+            }
+        }
+    });
+
+    Parallel::forRangeIndexed(m_rows, 1, m_threadCount, [&](int worker, int begin, int end) {
+        double *sumReal = workerScratch(worker, 2 * m_cols);
+        double *sumImag = sumReal + m_cols;
+
+        for (int v = begin; v < end; ++v) {
+            const float *c = colMatrix->cosRow(v);
+            const float *s = colMatrix->sinRow(v);
+
+            memset(sumReal, 0, m_cols * sizeof(double));
+            memset(sumImag, 0, m_cols * sizeof(double));
+
+            for (int y = 0; y < m_rows; ++y) {
+                const double wr = c[y];
+                const double wi = s[y];
+                const double *fr = &planeReal[y * m_cols];
+                const double *fi = &planeImag[y * m_cols];
+
+                for (int u = 0; u < m_cols; ++u) {
+                    sumReal[u] += fr[u] * wr - fi[u] * wi;
+                    sumImag[u] += fi[u] * wr + fr[u] * wi;
+                }
+            }
+
+            Complex *out = &output[v * m_cols];
+            for (int u = 0; u < m_cols; ++u)
+                out[u] = Complex(sumReal[u] * norm, sumImag[u] * norm);
+        }
+    });
+
+    m_pool->release(planeReal);
+    m_pool->release(planeImag);
+}
+
+// Per-thread scratch, kept between calls like in FFTCpu
+double *SeparableDFTCpu::workerScratch(int worker, int size)
+{
+    QPair<double *, int> &buffer = m_scratch[worker];
+    if (buffer.second < size) {
+        m_pool->release(buffer.first);
+        buffer.first = m_pool->acquire<double>(size);
+        buffer.second = size;
+    }
+
+    return buffer.first;
+}
@@ -0,0 +1,27 @@
+#ifndef SEPARABLEDFTCPU_H
+#define SEPARABLEDFTCPU_H
+
+#include <QPair>
+#include <QVector>
+
+#include "ft.h"
+
+// Exact DFT of any size, computed as a row pass and a column pass with
+// precomputed DFTMatrix factors: O(rows * cols * (rows + cols)) instead of
+// the O(rows^2 * cols^2) of DFTCpu. Sums are accumulated in double, which
+// makes it a reference for sizes the FFT engines reject.
+class SeparableDFTCpu : public FT {
+public:
+    explicit SeparableDFTCpu(FImage *image, QObject *parent = 0);
+    ~SeparableDFTCpu();
+
+private:
+    Complex *calculateFourier(Complex *input, bool inverse = false);
+    void calculateFourierInto(const Complex *input, Complex *output, bool inverse);
+
+    double *workerScratch(int worker, int size);
+
+    QVector<QPair<double *, int> > m_scratch;
+};
+
+#endif // SEPARABLEDFTCPU_H
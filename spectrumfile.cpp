@@ -0,0 +1,199 @@
+#include "spectrumfile.h"
+
+#include <string.h>
+
+#include <QSaveFile>
+
+static const char kMagic[8] = { 'F', 'T', 'S', 'P', 'E', 'C', 'T', 'R' };
+
+// Sections start on page boundaries, which also suits any vector alignment
+static const quint64 kSectionAlignment = 4096;
+
+enum FileFlag {
+    ShiftedFlag = 0x1
+};
+
+// On-disk header; a section offset of 0 means the section is absent
+struct FileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 cols;
+    quint32 rows;
+    quint32 layout;
+    quint32 format;
+    quint32 flags;
+    quint32 idBytes;
+    quint32 reserved;
+    quint64 spectrumOffset;
+    quint64 magnitudeOffset;
+    quint64 phaseOffset;
+};
+
+Q_STATIC_ASSERT(sizeof(FileHeader) == 64);
+
+static quint64 aligned(quint64 offset)
+{
+    return (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+}
+
+static int spectrumCols(int cols, FT::SpectrumLayout layout)
+{
+    return layout == FT::HalfSpectrum ? cols / 2 + 1 : cols;
+}
+
+static bool writeSection(QSaveFile &file, quint64 offset, const void *data, qint64 bytes)
+{
+    if (!offset)
+        return true;
+
+    return file.seek(offset) && file.write(static_cast<const char *>(data), bytes) == bytes;
+}
+
+SpectrumFile::Header::Header()
+    : cols(0)
+    , rows(0)
+    , layout(FT::FullSpectrum)
+    , format(SpectrumStorage::Float32)
+    , shifted(false)
+{
+}
+
+bool SpectrumFile::write(const QString &path, const Header &header, const void *spectrum,
+                         const float *magnitude, const float *phase)
+{
+    const QByteArray id = header.sourceId.toUtf8();
+    const int cols = ::spectrumCols(header.cols, header.layout);
+    const qint64 spectrumBytes = SpectrumStorage::bytes(header.format, header.rows, cols);
+    const qint64 polarBytes = (qint64)header.rows * cols * sizeof(float);
+
+    FileHeader fileHeader;
+    memset(&fileHeader, 0, sizeof(fileHeader));
+    memcpy(fileHeader.magic, kMagic, sizeof(kMagic));
+    fileHeader.version = Version;
+    fileHeader.cols = header.cols;
+    fileHeader.rows = header.rows;
+    fileHeader.layout = header.layout;
+    fileHeader.format = header.format;
+    fileHeader.flags = header.shifted ? ShiftedFlag : 0;
+    fileHeader.idBytes = id.size();
+
+    quint64 offset = aligned(sizeof(fileHeader) + id.size());
+    fileHeader.spectrumOffset = offset;
+    offset = aligned(offset + spectrumBytes);
+    if (magnitude) {
+        fileHeader.magnitudeOffset = offset;
+        offset = aligned(offset + polarBytes);
+    }
+    if (phase)
+        fileHeader.phaseOffset = offset;
+
+    // Written to a new file that only replaces path once complete, so a
+    // failed write leaves an existing file, and any mapping of it, intact
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning("Unable to create %s: %s", qPrintable(path), qPrintable(file.errorString()));
+        return false;
+    }
+
+    const bool ok = file.write(reinterpret_cast<const char *>(&fileHeader), sizeof(fileHeader)) == sizeof(fileHeader)
+                    && file.write(id.constData(), id.size()) == id.size()
+                    && writeSection(file, fileHeader.spectrumOffset, spectrum, spectrumBytes)
+                    && writeSection(file, fileHeader.magnitudeOffset, magnitude, polarBytes)
+                    && writeSection(file, fileHeader.phaseOffset, phase, polarBytes)
+                    && file.commit();
+    if (!ok)
+        qWarning("Unable to write %s: %s", qPrintable(path), qPrintable(file.errorString()));
+
+    return ok;
+}
+
+SpectrumFile::SpectrumFile()
+    : m_spectrum(0)
+    , m_magnitude(0)
+    , m_phase(0)
+{
+}
+
+bool SpectrumFile::open(const QString &path)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning("Unable to open %s: %s", qPrintable(path), qPrintable(m_file.errorString()));
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+    uchar *data = size >= (qint64)sizeof(FileHeader) ? m_file.map(0, size, QFileDevice::MapPrivateOption) : 0;
+
+    FileHeader fileHeader;
+    if (data)
+        memcpy(&fileHeader, data, sizeof(fileHeader));
+    if (!data || memcmp(fileHeader.magic, kMagic, sizeof(kMagic))) {
+        qWarning("%s is not a spectrum file", qPrintable(path));
+        return false;
+    }
+    if (fileHeader.version != Version) {
+        qWarning("%s is a version %u spectrum file; version %d is supported",
+                 qPrintable(path), fileHeader.version, (int)Version);
+        return false;
+    }
+
+    const FT::SpectrumLayout layout = (FT::SpectrumLayout)fileHeader.layout;
+    const SpectrumStorage::Format format = (SpectrumStorage::Format)fileHeader.format;
+    const bool known = fileHeader.cols && fileHeader.rows && layout <= FT::HalfSpectrum
+                       && format < SpectrumStorage::FORMATCOUNT;
+
+    const int cols = ::spectrumCols(fileHeader.cols, layout);
+    const quint64 spectrumBytes = known ? SpectrumStorage::bytes(format, fileHeader.rows, cols) : 0;
+    const quint64 polarBytes = (quint64)fileHeader.rows * cols * sizeof(float);
+
+    auto fits = [&](quint64 offset, quint64 bytes) {
+        return !offset || (offset % kSectionAlignment == 0 && offset + bytes <= (quint64)size);
+    };
+
+    if (!known || sizeof(fileHeader) + fileHeader.idBytes > (quint64)size || !fileHeader.spectrumOffset
+        || !fits(fileHeader.spectrumOffset, spectrumBytes) || !fits(fileHeader.magnitudeOffset, polarBytes)
+        || !fits(fileHeader.phaseOffset, polarBytes)) {
+        qWarning("%s is damaged or truncated", qPrintable(path));
+        return false;
+    }
+
+    m_header.cols = fileHeader.cols;
+    m_header.rows = fileHeader.rows;
+    m_header.layout = layout;
+    m_header.format = format;
+    m_header.shifted = fileHeader.flags & ShiftedFlag;
+    m_header.sourceId = QString::fromUtf8(reinterpret_cast<const char *>(data) + sizeof(fileHeader),
+                                          fileHeader.idBytes);
+
+    m_spectrum = data + fileHeader.spectrumOffset;
+    m_magnitude = fileHeader.magnitudeOffset ? reinterpret_cast<float *>(data + fileHeader.magnitudeOffset) : 0;
+    m_phase = fileHeader.phaseOffset ? reinterpret_cast<float *>(data + fileHeader.phaseOffset) : 0;
+
+    return true;
+}
+
+const SpectrumFile::Header &SpectrumFile::header() const
+{
+    return m_header;
+}
+
+int SpectrumFile::spectrumCols() const
+{
+    return ::spectrumCols(m_header.cols, m_header.layout);
+}
+
+void *SpectrumFile::spectrum() const
+{
+    return m_spectrum;
+}
+
+float *SpectrumFile::magnitude() const
+{
+    return m_magnitude;
+}
+
+float *SpectrumFile::phase() const
+{
+    return m_phase;
+}
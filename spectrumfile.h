@@ -0,0 +1,63 @@
+#ifndef SPECTRUMFILE_H
+#define SPECTRUMFILE_H
+
+#include <QFile>
+#include <QString>
+
+#include "ft.h"
+#include "spectrumstorage.h"
+
+// Binary file of a computed spectrum, and of its magnitude and phase if
+// they were computed too. A 64 byte header (magic, version, dimensions,
+// layout, storage format, shift state, sections) and the UTF-8 id of the
+// source image are followed by the raw sections, each starting on a page
+// boundary so it can be used in place once the file is mapped. Values are
+// stored in the byte order of the machine, as in memory.
+class SpectrumFile {
+public:
+    enum { Version = 1 };
+
+    struct Header {
+        Header();
+
+        int cols;
+        int rows;
+        FT::SpectrumLayout layout;
+        SpectrumStorage::Format format;
+
+        // Whether the zero frequency was moved to the center. FT keeps and
+        // writes spectra unshifted.
+        bool shifted;
+
+        QString sourceId;
+    };
+
+    // Either of magnitude and phase may be 0 to leave it out
+    static bool write(const QString &path, const Header &, const void *spectrum,
+                      const float *magnitude, const float *phase);
+
+    SpectrumFile();
+
+    // Checks the header and maps the whole file. The mapping is private:
+    // writes to it stay in memory and never reach the file.
+    bool open(const QString &path);
+
+    const Header &header() const;
+    int spectrumCols() const;
+
+    // Sections of the mapped file; magnitude() and phase() are 0 if absent
+    void *spectrum() const;
+    float *magnitude() const;
+    float *phase() const;
+
+private:
+    Q_DISABLE_COPY(SpectrumFile)
+
+    QFile m_file;
+    Header m_header;
+    void *m_spectrum;
+    float *m_magnitude;
+    float *m_phase;
+};
+
+#endif // SPECTRUMFILE_H
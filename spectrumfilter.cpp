@@ -0,0 +1,144 @@
+#include "spectrumfilter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SPECTRUMFILTER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "ft.h"
+
+// Keeps a zero radius from turning the center's distance into 0 * inf
+static const float kMinRadius2 = 1e-12f;
+
+SpectrumFilter SpectrumFilter::lowPass(float cutoff, int order)
+{
+    SpectrumFilter filter(LowPass, order);
+    filter.addCircle(0.0f, 0.0f, cutoff, false);
+    return filter;
+}
+
+SpectrumFilter SpectrumFilter::highPass(float cutoff, int order)
+{
+    SpectrumFilter filter(HighPass, order);
+    filter.addCircle(0.0f, 0.0f, cutoff, true);
+    return filter;
+}
+
+SpectrumFilter SpectrumFilter::bandPass(float low, float high, int order)
+{
+    SpectrumFilter filter(BandPass, order);
+    filter.addCircle(0.0f, 0.0f, high, false);
+    filter.addCircle(0.0f, 0.0f, low, true);
+    return filter;
+}
+
+SpectrumFilter SpectrumFilter::notch(float u, float v, float radius, int order)
+{
+    SpectrumFilter filter(Notch, order);
+    filter.addCircle(u, v, radius, true);
+    filter.addCircle(-u, -v, radius, true);
+    return filter;
+}
+
+// Passes everything
+SpectrumFilter::SpectrumFilter()
+    : m_type(LowPass)
+    , m_order(0)
+    , m_circleCount(0)
+{
+}
+
+SpectrumFilter::SpectrumFilter(Type type, int order)
+    : m_type(type)
+    , m_order(qMax(0, order))
+    , m_circleCount(0)
+{
+}
+
+SpectrumFilter::Type SpectrumFilter::type() const
+{
+    return m_type;
+}
+
+int SpectrumFilter::order() const
+{
+    return m_order;
+}
+
+void SpectrumFilter::addCircle(float u, float v, float radius, bool reject)
+{
+    Circle &circle = m_circles[m_circleCount++];
+    circle.u = u;
+    circle.v = v;
+    circle.inverseRadius2 = 1.0f / qMax(radius * radius, kMinRadius2);
+    circle.reject = reject;
+}
+
+// With r2 the squared distance over the squared radius, a circle passes
+// r2 <= 1 when ideal and 1 / (1 + r2^order) as a Butterworth mask
+void SpectrumFilter::apply(const Complex *input, Complex *output, const float *u, float v, int count) const
+{
+    int x = 0;
+
+#ifdef SPECTRUMFILTER_SSE2
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for (; x + 4 <= count; x += 4) {
+        const __m128 frequency = _mm_loadu_ps(u + x);
+        __m128 gain = one;
+
+        for (int c = 0; c < m_circleCount; ++c) {
+            const Circle &circle = m_circles[c];
+            const float dv = v - circle.v;
+            const __m128 du = _mm_sub_ps(frequency, _mm_set1_ps(circle.u));
+            const __m128 r2 = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(du, du), _mm_set1_ps(dv * dv)),
+                                         _mm_set1_ps(circle.inverseRadius2));
+
+            __m128 pass;
+            if (m_order) {
+                __m128 power = r2;
+                for (int k = 1; k < m_order; ++k)
+                    power = _mm_mul_ps(power, r2);
+                pass = _mm_div_ps(one, _mm_add_ps(one, power));
+            } else {
+                pass = _mm_and_ps(_mm_cmple_ps(r2, one), one);
+            }
+
+            gain = _mm_mul_ps(gain, circle.reject ? _mm_sub_ps(one, pass) : pass);
+        }
+
+        // Each gain scales the real and imaginary part of its value
+        const float *in = &input[x].real;
+        float *out = &output[x].real;
+        const __m128 low = _mm_mul_ps(_mm_loadu_ps(in), _mm_unpacklo_ps(gain, gain));
+        const __m128 high = _mm_mul_ps(_mm_loadu_ps(in + 4), _mm_unpackhi_ps(gain, gain));
+        _mm_storeu_ps(out, low);
+        _mm_storeu_ps(out + 4, high);
+    }
+#endif
+
+    for (; x < count; ++x) {
+        float gain = 1.0f;
+
+        for (int c = 0; c < m_circleCount; ++c) {
+            const Circle &circle = m_circles[c];
+            const float du = u[x] - circle.u;
+            const float dv = v - circle.v;
+            const float r2 = (du * du + dv * dv) * circle.inverseRadius2;
+
+            float pass;
+            if (m_order) {
+                float power = r2;
+                for (int k = 1; k < m_order; ++k)
+                    power *= r2;
+                pass = 1.0f / (1.0f + power);
+            } else {
+                pass = r2 <= 1.0f ? 1.0f : 0.0f;
+            }
+
+            gain *= circle.reject ? 1.0f - pass : pass;
+        }
+
+        output[x] = Complex(input[x].real * gain, input[x].imag * gain);
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef SPECTRUMFILTER_H
+#define SPECTRUMFILTER_H
+
+struct Complex;
+
+// Parametric mask over a spectrum, evaluated for each value as it is
+// applied rather than stored. Frequencies are fractions of the Nyquist
+// frequency along each axis, so 1.0 is the highest frequency of a row or
+// column and a filter means the same on images of any size. Order 0 is an
+// ideal mask with a hard edge, higher orders a Butterworth mask that rolls
+// off more steeply with each order. Every mask is symmetric under
+// (u, v) -> (-u, -v), so a filtered real spectrum stays real.
+class SpectrumFilter {
+public:
+    enum Type {
+        LowPass = 0,
+        HighPass,
+        BandPass,
+        Notch
+    };
+
+    static SpectrumFilter lowPass(float cutoff, int order = 2);
+    static SpectrumFilter highPass(float cutoff, int order = 2);
+    static SpectrumFilter bandPass(float low, float high, int order = 2);
+
+    // Rejects the frequency (u, v), and its mirror (-u, -v), within radius
+    static SpectrumFilter notch(float u, float v, float radius, int order = 2);
+
+    SpectrumFilter();
+
+    Type type() const;
+    int order() const;
+
+    // output[x] = input[x] times the mask at frequency (u[x], v), for count
+    // values of one spectrum row; output may be input
+    void apply(const Complex *input, Complex *output, const float *u, float v, int count) const;
+
+private:
+    // The mask is the product of up to two circles around a center, each
+    // passing what lies inside it or rejecting it
+    struct Circle {
+        float u;
+        float v;
+        float inverseRadius2;
+        bool reject;
+    };
+
+    SpectrumFilter(Type, int order);
+    void addCircle(float u, float v, float radius, bool reject);
+
+    Type m_type;
+    int m_order;
+    int m_circleCount;
+    Circle m_circles[2];
+};
+
+#endif // SPECTRUMFILTER_H
@@ -0,0 +1,170 @@
+#include "spectrumstorage.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "ft.h"
+
+static inline quint32 floatBits(float value)
+{
+    quint32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline float bitsFloat(quint32 bits)
+{
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// IEEE half conversions with round to nearest even; overflow saturates to
+// infinity and NaNs stay NaNs.
+static inline quint16 toHalf(float value)
+{
+    const quint32 infinity = 255u << 23;
+    const quint32 overflow = (127u + 16) << 23;
+    const quint32 denormMagic = ((127u - 15) + (23 - 10) + 1) << 23;
+
+    quint32 bits = floatBits(value);
+    const quint32 sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    quint16 half;
+    if (bits >= overflow) {
+        half = bits > infinity ? 0x7e00 : 0x7c00;
+    } else if (bits < (113u << 23)) {
+        // Below the smallest normal half: let the float adder round
+        half = floatBits(bitsFloat(bits) + bitsFloat(denormMagic)) - denormMagic;
+    } else {
+        const quint32 odd = (bits >> 13) & 1;
+        bits += ((quint32)(15 - 127) << 23) + 0xfff + odd;
+        half = bits >> 13;
+    }
+
+    return half | (sign >> 16);
+}
+
+static inline float fromHalf(quint16 half)
+{
+    const quint32 exponentMask = 0x7c00u << 13;
+
+    quint32 bits = (half & 0x7fffu) << 13;
+    const quint32 exponent = bits & exponentMask;
+    bits += (127u - 15) << 23;
+
+    if (exponent == exponentMask) {
+        bits += (128u - 16) << 23;
+    } else if (exponent == 0) {
+        bits += 1u << 23;
+        bits = floatBits(bitsFloat(bits) - bitsFloat(113u << 23));
+    }
+
+    return bitsFloat(bits | ((half & 0x8000u) << 16));
+}
+
+static inline quint16 toBFloat(float value)
+{
+    const quint32 bits = floatBits(value);
+    if ((bits & 0x7fffffffu) > 0x7f800000u)
+        return (bits >> 16) | 0x40;
+
+    return (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+}
+
+static inline float fromBFloat(quint16 value)
+{
+    return bitsFloat((quint32)value << 16);
+}
+
+QString SpectrumStorage::name(Format format)
+{
+    switch (format) {
+    case Float32:
+        return QStringLiteral("fp32");
+    case Float16:
+        return QStringLiteral("fp16");
+    case BFloat16:
+        return QStringLiteral("bf16");
+    default:
+        return QString();
+    }
+}
+
+size_t SpectrumStorage::bytes(Format format, int rows, int cols)
+{
+    const size_t values = 2 * (size_t)rows * cols;
+
+    switch (format) {
+    case Float16:
+        return rows * sizeof(float) + values * sizeof(quint16);
+    case BFloat16:
+        return values * sizeof(quint16);
+    default:
+        return values * sizeof(float);
+    }
+}
+
+// Float16 layout: rows float scales, then the rows of packed values
+void SpectrumStorage::pack(Format format, const Complex *input, int rows, int cols, void *output)
+{
+    if (format == Float32) {
+        memcpy(output, input, bytes(format, rows, cols));
+        return;
+    }
+
+    float *scales = static_cast<float *>(output);
+    quint16 *values = reinterpret_cast<quint16 *>(format == Float16 ? scales + rows : scales);
+
+    for (int r = 0; r < rows; ++r) {
+        const float *row = &input[r * cols].real;
+        quint16 *packed = values + 2 * r * cols;
+
+        if (format == BFloat16) {
+            for (int i = 0; i < 2 * cols; ++i)
+                packed[i] = toBFloat(row[i]);
+            continue;
+        }
+
+        float peak = 0.0;
+        for (int i = 0; i < 2 * cols; ++i)
+            peak = qMax(peak, qAbs(row[i]));
+
+        // Largest packed value stays below 2^15, well inside the half range
+        int exponent = 0;
+        frexp(peak, &exponent);
+        const float scale = ldexp(1.0f, exponent - 15);
+        const float inverse = 1.0f / scale;
+
+        scales[r] = scale;
+        for (int i = 0; i < 2 * cols; ++i)
+            packed[i] = toHalf(row[i] * inverse);
+    }
+}
+
+void SpectrumStorage::unpack(Format format, const void *input, int rows, int cols, Complex *output)
+{
+    if (format == Float32) {
+        memcpy(output, input, bytes(format, rows, cols));
+        return;
+    }
+
+    const float *scales = static_cast<const float *>(input);
+    const quint16 *values = reinterpret_cast<const quint16 *>(format == Float16 ? scales + rows : scales);
+
+    for (int r = 0; r < rows; ++r) {
+        float *row = &output[r * cols].real;
+        const quint16 *packed = values + 2 * r * cols;
+
+        if (format == BFloat16) {
+            for (int i = 0; i < 2 * cols; ++i)
+                row[i] = fromBFloat(packed[i]);
+            continue;
+        }
+
+        const float scale = scales[r];
+        for (int i = 0; i < 2 * cols; ++i)
+            row[i] = fromHalf(packed[i]) * scale;
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef SPECTRUMSTORAGE_H
+#define SPECTRUMSTORAGE_H
+
+#include <QString>
+
+struct Complex;
+
+// Compact storage for spectra that are computed in float. Float16 keeps one
+// power-of-two scale per row, since spectrum values of large images exceed
+// the half float range; BFloat16 has the float exponent range and needs none.
+// Both halve the memory of a spectrum at the cost of mantissa bits.
+class SpectrumStorage {
+public:
+    enum Format {
+        Float32 = 0,
+        Float16,
+        BFloat16,
+        FORMATCOUNT
+    };
+
+    static QString name(Format);
+    static size_t bytes(Format, int rows, int cols);
+
+    static void pack(Format, const Complex *input, int rows, int cols, void *output);
+    static void unpack(Format, const void *input, int rows, int cols, Complex *output);
+};
+
+#endif // SPECTRUMSTORAGE_H
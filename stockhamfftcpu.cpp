@@ -0,0 +1,23 @@
+#include "stockhamfftcpu.h"
+
+#include "fftkernels.h"
+#include "fftplan.h"
+
+StockhamFFTCpu::StockhamFFTCpu(FImage *image, QObject *parent)
+    : FFTCpu(image, parent)
+{
+}
+
+StockhamFFTCpu::~StockhamFFTCpu()
+{
+}
+
+QString StockhamFFTCpu::variant() const
+{
+    return QStringLiteral("Stockham autosort");
+}
+
+void StockhamFFTCpu::fft1D(float *real, float *imag, float *work, const FFTPlan &plan) const
+{
+    FFTKernels::stockham(real, imag, work, work + plan.size(), plan);
+}
@@ -0,0 +1,17 @@
+#ifndef STOCKHAMFFTCPU_H
+#define STOCKHAMFFTCPU_H
+
+#include "fftcpu.h"
+
+class StockhamFFTCpu : public FFTCpu {
+public:
+    explicit StockhamFFTCpu(FImage *image, QObject *parent = 0);
+    ~StockhamFFTCpu();
+
+    QString variant() const;
+
+protected:
+    void fft1D(float *, float *, float *, const FFTPlan &) const;
+};
+
+#endif // STOCKHAMFFTCPU_H